@@ -15,9 +15,27 @@ void clear_screen(uint32_t *buf, uint32_t color);
 void draw_rect(uint32_t *buf, int x, int y, int w, int h, uint32_t color);
 void draw_circle_filled(uint32_t *buf, int cx, int cy, int radius, uint32_t color);
 void draw_rounded_rect(uint32_t *buf, int x, int y, int w, int h, int radius, uint32_t color);
+void draw_circle_filled_aa(uint32_t *buf, int cx, int cy, int radius, uint32_t color);
+void draw_rounded_rect_aa(uint32_t *buf, int x, int y, int w, int h, int radius, uint32_t color);
 int measure_text_width(const char *text, int font_size);
 void draw_text(uint32_t *buf, const char *text, int font_size, int x, int y, uint32_t color);
 void draw_text_centered(uint32_t *buf, const char *text, int font_size, int y, uint32_t color);
+void draw_image(uint32_t *buf, const uint32_t *pixels, int w, int h, int x, int y);
+
+// Damage tracking - apps call these when their state changes what is on screen
+void invalidate_rect(int x, int y, int w, int h);
+void invalidate_screen(void);
+
+// Wake the shell's event loop - safe to call from any thread
+void wake_main_loop(void);
+
+// Background jobs - work(data) runs on a worker thread, then done(data) runs on
+// the UI thread and the x/y/w/h region is redrawn (pass w = 0 for none).
+// work must not touch state the app draws from; hand results over in data.
+// Returns 0 if the queue is full.
+typedef void (*JobWork)(void *data);
+typedef void (*JobDone)(void *data);
+int submit_job(JobWork work, JobDone done, void *data, int x, int y, int w, int h);
 
 // Color definitions
 #define COLOR_BG 0xFF000000
@@ -38,11 +56,34 @@ void draw_text_centered(uint32_t *buf, const char *text, int font_size, int y, u
 #define ICON_SIZE 200
 #define MARGIN 60
 
-// App drawing function prototypes
-void draw_test_app(uint32_t *buf);
+// App modules
+//
+// Every app is a shared object in the shell's apps directory; the file name
+// without ".so" is the name shown under its icon. A module exports one
+// AppModule named by APP_MODULE_SYMBOL:
+//
+//     const AppModule app_module = {APP_MODULE_ABI_VERSION, draw_my_app, handle_my_app_touch};
+//
+// The shell dlopens the module when the app is first launched and dlcloses
+// it once the app has been closed from the switcher and its jobs have
+// finished. The functions above resolve against the shell executable, so it
+// must be linked with -rdynamic. Build a module with
+//     gcc -shared -fPIC -o apps/MyApp.so my_app.c
+#define APP_MODULE_ABI_VERSION 1
+#define APP_MODULE_SYMBOL "app_module"
 
-// App drawing function pointer array
-typedef void (*AppDrawFunction)(uint32_t *buf);
-extern AppDrawFunction app_draw_functions[12];
+typedef struct {
+    uint32_t abi_version;       // APP_MODULE_ABI_VERSION the module was built against
+    // Draws the app's screen. The shell records the calls into a display list
+    // and replays them later, so buf is NULL: pass it to the drawing functions
+    // above and never write pixels through it. draw_image keeps the pixels
+    // pointer and hashes the pixels only when recorded, so an image must stay
+    // allocated and unchanged until the next draw. After changing one, call
+    // invalidate_rect so draw runs again.
+    void (*draw)(uint32_t *buf);
+    void (*touch)(int touch_x, int touch_y, int is_pressed, int was_pressed);
+    void (*resume)(void);       // Optional: the app is about to be shown
+    void (*suspend)(void);      // Optional: the app left the screen but stays open
+} AppModule;
 
 #endif // APPS_H
\ No newline at end of file
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Build the shell and the Test app module, then check the --snapshot goldens
+# in snapshots/.
+#
+# Goldens are not committed: they depend on the installed Inter-Regular.otf,
+# which is not part of the tree. Record them once from a known-good build:
+#     ./check_snapshots.sh --update
+# and again after every intended visual change. Later runs fail on any pixel
+# that differs, and on any capture that has no golden.
+set -e
+cd "$(dirname "$0")"
+mkdir -p build apps snapshots
+cc -O2 -rdynamic -o build/phone fb_graphics.c -lm -lpthread -ldl
+cc -O2 -shared -fPIC -o apps/Test.so test.c
+
+if [ "$1" != "--update" ] && ! ls snapshots/*.ppm >/dev/null 2>&1; then
+    echo "No goldens in snapshots/. Record them from a known-good build first:" >&2
+    echo "    $0 --update" >&2
+    exit 1
+fi
+exec ./build/phone --snapshot snapshots "$@"
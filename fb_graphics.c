@@ -9,18 +9,155 @@
 #include <linux/fb.h>
 #include <linux/input.h>
 #include <sys/mman.h>
-#include <poll.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 #include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <errno.h>
+#include <dlfcn.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#define HAVE_NEON_KERNELS 1
+#endif
 #include "apps.h"
 
 #define FONT_PATH "Inter-Regular.otf"
 
+// App modules, one shared object per app (override with -DAPPS_DIR=...)
+#ifndef APPS_DIR
+#define APPS_DIR "apps"
+#endif
+#define MAX_APPS 12
+
+// Background app surfaces are kept run-length compressed in a pool that evicts
+// the least recently used past this budget (override with -DSURFACE_BUDGET_BYTES=...)
+#ifndef SURFACE_BUDGET_BYTES
+#define SURFACE_BUDGET_BYTES (8 * 1024 * 1024)
+#endif
+#define GLYPH_PACK_PATH FONT_PATH ".glyphs"
+
+// Glyph cache sizing (coverage atlas bytes, override with -DGLYPH_CACHE_BYTES=...)
+#ifndef GLYPH_CACHE_BYTES
+#define GLYPH_CACHE_BYTES (1024 * 1024)
+#endif
+#define GLYPH_ATLAS_WIDTH 1024
+#define GLYPH_ATLAS_MIN_HEIGHT 256
+#define GLYPH_SHELF_ROUND 4
+#define GLYPH_MAX_GLYPHS 1024
+#define GLYPH_HASH_SIZE 512
+
+// Prebuilt glyph pack: printable ASCII at the UI text sizes, rasterized once
+// and mmapped at boot. Bump the version whenever the file layout changes.
+#define GLYPH_PACK_MAGIC "FBGLYPH"
+#define GLYPH_PACK_VERSION 2
+#define GLYPH_PACK_SIZES 3
+#define GLYPH_PACK_FIRST 32
+#define GLYPH_PACK_COUNT 95
+#define GLYPH_SHELF_PACKED -2       // Glyph.shelf for coverage in the pack's atlas
+
+// Text layout cache: laid-out runs keyed by (string, size), in sets of
+// TEXT_LAYOUT_WAYS replaced least recently used first
+#define TEXT_LAYOUT_CACHE_SIZE 256
+#define TEXT_LAYOUT_WAYS 4
+
+// Damage tracking
+#define MAX_DAMAGE_RECTS 16
+#define TOUCH_DOT_RADIUS 8
+
+// Display list arenas start at this size and double as needed
+#define DL_INITIAL_BYTES 4096
+
+// Render worker threads
+#define MAX_RENDER_THREADS 64
+
+// Display lists covering at least this many tiles replay one tile per task
+#define TILE_SIZE 64
+#define TILE_MIN_COUNT 4
+
+// Background jobs submitted by apps
+#define MAX_JOB_THREADS 2
+#define MAX_JOBS 32
+
+// Background blur: home screen is blurred at 1/BLUR_DOWNSAMPLE resolution and
+// cached per quantized level (level 0 means unblurred)
+#define BLUR_DOWNSAMPLE 4
+#define BLUR_LEVELS 6
+#define BLUR_MAX_RADIUS 6
+#define BLUR_PASSES 3
+#define BLUR_MAX_DARKEN 20
+
+// Window scaler: sources are mipmapped by 2x per level below 0.5x
+#define SCALE_MIP_LEVELS 4
+
+// App snapshots: switcher thumbnails are this tall, width follows the screen aspect
+#define APP_THUMB_HEIGHT 160
+
+// Event loop
+#define FRAME_INTERVAL_NS 16666667
+#define MAX_CATCHUP_FRAMES 4
+#define MAX_LOOP_EVENTS 32
+
+// Animations: values move in monotonic time, so frame rate only changes how often they're sampled
+#define MAX_ANIMATIONS 16
+#define WINDOW_SPRING_OMEGA 40.0f   // rad/s, critically damped: settles in about 0.2s
+#define SCALE_PRECISION 0.005f
+#define POSITION_PRECISION 0.5f
+#define QUICK_SWIPE_MS 180
+
+// Presentation: pages requested in yres_virtual for page flipping
+#define MAX_FB_PAGES 3
+
+// Headless backend: default size, frames per timing sample, script limits
+#define HEADLESS_DEFAULT_W 1080
+#define HEADLESS_DEFAULT_H 1920
+#define SNAPSHOT_TIMING_RUNS 20
+#define SNAPSHOT_CLOCK 1700000000
+#define MAX_SCRIPT_LINE 256
+
+// Frame statistics (build with -DPERF_STATS=0 to compile the probes out entirely).
+// Histograms are log-linear over microseconds: 16 linear buckets per power of two.
+#ifndef PERF_STATS
+#define PERF_STATS 1
+#endif
+#define PERF_SUB_BUCKETS 16
+#define PERF_BUCKETS (27 * PERF_SUB_BUCKETS)
+#define PERF_WINDOW_MS 10000
+#define PERF_HUD_SAMPLES 120
+#define PERF_HUD_W (PERF_HUD_SAMPLES * 2)
+#define PERF_HUD_H 140
+#define PERF_HUD_TEXT 24
+#define PERF_HUD_RANGE_US 33333
+
+// Touch samples queued from the input thread (power of two)
+#define INPUT_RING_SIZE 1024
+#define INPUT_READ_BATCH 64         // evdev events per read()
+#define MAX_TOUCH_SLOTS 10
+#define MAX_TOUCH_DEVICES 16
+#define INPUT_HOTPLUG_ID UINT32_MAX // epoll tag of the /dev/input watch
+
+// Velocity estimation: least squares over each contact's recent samples
+#define VELOCITY_SAMPLES 16
+#define VELOCITY_WINDOW_US 100000   // Only samples this recent count
+#define VELOCITY_STILL_US 40000     // A contact quiet this long reads as still
+
 // Enhanced touch constants
 #define SWIPE_THRESHOLD 100
-#define SWIPE_TIME_LIMIT 300
+#define FLICK_VELOCITY 1000         // Upward px/s at release that makes a swipe
+
+// Drags are drawn where the finger is predicted to be at present time, at most this far ahead
+#define PREDICT_DEFAULT_MS 16
 
 typedef enum { 
     HOME_SCREEN, 
@@ -32,12 +169,71 @@ typedef struct {
     char name[32];
     uint32_t color;
     int id;
+    char path[256];             // Module shared object
+    void *handle;               // dlopen handle, NULL while unloaded
+    const AppModule *module;
+    int jobs;                   // Submitted by the module and not yet completed
+    int unload_pending;         // Closed while jobs were outstanding
 } App;
 
+// Input thread's view of one contact in the report being assembled
+typedef struct {
+    int x, y, tracking;
+    int dirty;                      // Changed since the last SYN_REPORT
+} DeviceSlot;
+
+typedef enum {
+    DEVICE_IGNORED,                 // Not a touchscreen: keys, mice, touchpads, sensors
+    DEVICE_SINGLE_TOUCH,            // ABS_X/ABS_Y and BTN_TOUCH
+    DEVICE_MULTITOUCH_A,            // ABS_MT positions without slots
+    DEVICE_MULTITOUCH_B             // ABS_MT_SLOT: one slot per contact
+} DeviceClass;
+
 typedef struct {
-    int fd, min_x, max_x, min_y, max_y;
+    int fd;                         // -1 for a free entry
+    char name[16];                  // Node under /dev/input, e.g. "event3"
+    int min_x, max_x, min_y, max_y;
+    int multitouch;                 // Type B: reads ABS_MT_* slots, else only ABS_X/ABS_Y/BTN_TOUCH
+    int slot;                       // Slot that ABS_MT_* events currently apply to
+    DeviceSlot slots[MAX_TOUCH_SLOTS];
+    int kernel_clock;               // Event timestamps are CLOCK_MONOTONIC
+    int dropped;                    // Got SYN_DROPPED, discarding up to the next SYN_REPORT
 } TouchDevice;
 
+// One contact's state as of a touch report. A report that changed several
+// contacts is queued as several samples, the last one marked end_of_report.
+typedef struct {
+    int x, y, pressed;
+    int slot, end_of_report;
+    uint64_t time_us;               // CLOCK_MONOTONIC, from the kernel when available
+} TouchSample;
+
+typedef struct {
+    int x, y;
+    uint64_t time_us;
+} TouchPoint;
+
+// UI thread's view of a contact, with its motion history
+typedef struct {
+    int active, went_down;          // went_down: since the last report was latched
+    int x, y;
+    uint64_t down_us;
+    TouchPoint history[VELOCITY_SAMPLES];
+    int history_len, history_head;
+    float vx, vy, ax, ay;           // px/s and px/s^2 at the newest sample
+} TouchContact;
+
+// Single-producer (input thread), single-consumer (UI thread) queue of touch reports
+typedef struct {
+    TouchSample samples[INPUT_RING_SIZE];
+    uint32_t head;                  // Written only by the producer
+    uint32_t tail;                  // Written only by the consumer
+    uint64_t pushed, dropped;       // Producer counters, read relaxed; dropped means the ring was full
+    uint64_t reads;                 // read() calls that returned events
+    uint64_t resyncs;               // Devices read back after SYN_DROPPED
+    uint32_t high_water;
+} InputRing;
+
 typedef struct {
     int x, y, pressed, last_pressed;
     int start_x, start_y;
@@ -48,40 +244,417 @@ typedef struct {
     int drag_start_y;
     int finger_x, finger_y;
     int swipe_detected;
+    int primary_slot;               // Contact the gesture code follows, -1 for none
+    float vx, vy, ax, ay;           // Its motion estimate, see estimate_velocity
+    uint64_t sample_us;             // Timestamp of the latched report
+    int predicting;                 // The last frame drew the drag ahead of sample_us
 } TouchState;
 
-// Apps configuration
-App apps[] = {
-    {"Test", COLOR_GREEN, 0}
-};
-#define APP_COUNT (sizeof(apps)/sizeof(apps[0]))
+typedef struct {
+    int x, y, w, h;
+} Rect;
 
-// App drawing function array
-AppDrawFunction app_draw_functions[12] = {
-    draw_test_app
-};
+// Converts a run of ARGB8888 pixels that starts at screen (x, y) into a panel
+// format; the position picks the ordered dither pattern
+typedef void (*ConvertKernel)(void *dst, const uint32_t *src, int count, int x, int y);
+
+// Row-level pixel kernels, one implementation per instruction set
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    void (*fill)(uint32_t *dst, uint32_t color, int count);
+    void (*darken)(uint32_t *dst, int amount, int count);
+    void (*copy)(uint32_t *dst, const uint32_t *src, int count);
+    void (*blend)(uint32_t *dst, uint32_t color, const uint8_t *coverage, int count);
+    ConvertKernel to_rgb565, to_bgr565, to_xbgr8888;
+} PixelKernels;
+
+typedef struct {
+    Rect rects[MAX_DAMAGE_RECTS];
+    int count;
+} DamageList;
+
+typedef enum {
+    DL_CLEAR,
+    DL_RECT,
+    DL_ROUNDED_RECT,
+    DL_CIRCLE,
+    DL_TEXT,
+    DL_IMAGE
+} DisplayOp;
+
+// One recorded draw call. Commands are packed back to back in the list's arena;
+// DL_TEXT is followed by its NUL-terminated string and DL_IMAGE by a DisplayImage.
+// Header and payload are each padded to 8 bytes, so every command and payload
+// starts 8-byte aligned. Unused bytes are zeroed so commands compare with memcmp.
+typedef struct {
+    _Alignas(8) uint8_t op;
+    uint8_t antialias;
+    uint16_t size;              // Bytes including the payload
+    int x, y, w, h;             // Circles keep the center in x, y and the radius in w
+    int radius;                 // Corner radius, or font size for text
+    uint32_t color;
+    Rect bounds;                // Every pixel the command can write
+} DisplayCmd;
+_Static_assert(sizeof(DisplayCmd) % 8 == 0, "DisplayCmd payloads must stay 8-byte aligned");
+
+typedef struct {
+    const uint32_t *pixels;
+    uint64_t hash;              // Content hash, so a changed image diffs as changed
+} DisplayImage;
+
+// Draw calls made while a list is recording are stored instead of rasterized
+typedef struct {
+    uint8_t *arena;
+    size_t used, capacity;
+    int count;
+    int valid;                  // Set once fully recorded
+} DisplayList;
+
+// Fork-join pool that splits a range of rows or columns across render threads
+typedef void (*RangeTask)(void *ctx, int start, int end);
+
+typedef struct {
+    pthread_t threads[MAX_RENDER_THREADS];
+    int num_threads;            // Including the calling thread
+    int active;                 // Threads new work is spread over, at most num_threads
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready, work_done;
+    uint64_t generation;
+    int participants;           // Active count when the current generation started
+    RangeTask task;
+    void *ctx;
+    int count, chunk;
+    int next;                   // Next unclaimed index, taken atomically
+    int busy_workers;
+} RenderPool;
+
+// Display list commands binned by the screen tiles their bounds touch. Each
+// bin lists command offsets in recording order, so a tile replays exactly the
+// commands a whole-list replay would draw there.
+typedef struct {
+    const DisplayList *list;
+    uint32_t *buf;
+    Rect area;                  // Clip the list is replayed into
+    int tiles_x, tiles_y;
+    int *bin_start;             // Per tile offset into cmds, plus one end entry
+    int *bin_fill;
+    uint32_t *cmds;
+    int bins_capacity, cmds_capacity;
+} TileBins;
+
+typedef struct {
+    JobWork work;
+    JobDone done;
+    void *data;
+    Rect dirty;
+    int owner;                  // App whose module submitted the job, -1 for the shell
+} Job;
+
+// Worker threads for app jobs; finished jobs wait for the UI thread in done[]
+typedef struct {
+    pthread_t threads[MAX_JOB_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    Job pending[MAX_JOBS], done[MAX_JOBS];
+    int pending_head, pending_count;
+    int done_head, done_count;
+    int outstanding;            // Submitted but not yet completed on the UI thread
+} JobPool;
+
+typedef struct {
+    int w, h;                   // Downsampled size
+    uint32_t *source;           // Downsampled home screen
+    uint32_t *scratch;          // Ping-pong buffer for the separable passes
+    uint32_t *levels[BLUR_LEVELS];
+    int level_valid[BLUR_LEVELS];
+    int source_valid;
+    DisplayList home_lists[2];  // home_lists[home_list] produced source
+    int home_list;
+    uint32_t *wide;             // Low-res rows stretched to full width
+    uint32_t *upsampled;        // Full-resolution result for one level
+    int upsampled_level;        // -1 when stale
+    int *col_index, *col_weight;
+} BlurCache;
+
+typedef enum {
+    SCALE_NEAREST,
+    SCALE_BILINEAR
+} ScaleFilter;
+
+// Per-column and per-row source index and 8-bit weight for one scale factor
+typedef struct {
+    int dst_w, dst_h, src_w, src_h;
+    ScaleFilter filter;
+    int *x_index, *x_weight;
+    int *y_index, *y_weight;
+    uint32_t *mips[SCALE_MIP_LEVELS];   // mips[0] is unused, level 0 is the caller's source
+    int mips_built;                     // Levels still matching the source, see window_scaler_source_changed
+} WindowScaler;
+
+typedef struct {
+    uint32_t *dest;
+    const uint32_t *src;
+    int src_w, src_h;
+    int x0, x1, y0;             // Clipped destination columns and first row
+    int start_x, start_y;       // Unclipped window origin on screen
+} ScaleJob;
+
+typedef enum {
+    PRESENT_COPY,               // Draw into a heap backbuffer, copy damage to the framebuffer
+    PRESENT_FLIP,               // Draw into an off-screen framebuffer page, pan to it
+    PRESENT_MEMORY              // Headless: the "framebuffer" is plain memory
+} PresentMode;
+
+typedef struct {
+    PresentMode mode;
+    struct fb_var_screeninfo vinfo;
+    size_t map_size;
+    const char *format;
+    int bytes_per_pixel;
+    ConvertKernel convert;      // NULL when the panel is XRGB8888 like our surfaces
+    int num_pages;
+    int front;                  // Page being scanned out
+    uint8_t *pages[MAX_FB_PAGES];
+    DamageList page_damage[MAX_FB_PAGES];   // Damage each page hasn't caught up with yet
+    int can_wait_vsync;
+} Presenter;
+
+typedef enum {
+    PERF_INPUT,                 // Touch sample age when the UI thread picks it up
+    PERF_TOUCH,                 // read_touch_events, including gesture handling
+    PERF_ANIMATE,               // update_animations
+    PERF_RENDER,                // render_frame over all damage rects
+    PERF_BLUR,                  // draw_blurred_home (inside render)
+    PERF_SCALE,                 // draw_scaled_window (inside render)
+    PERF_PRESENT,               // present_frame
+    PERF_LATENCY,               // Newest touch sample's timestamp to the frame showing it presented
+    PERF_FRAME,                 // Wakeup to presented
+    PERF_STAGE_COUNT
+} PerfStage;
+
+typedef struct {
+    uint32_t counts[PERF_BUCKETS];
+    uint32_t total;
+    uint32_t max_us;
+} PerfHistogram;
+
+typedef struct {
+    int enabled;
+    int hud;
+    const char *stats_path;     // Dumps are appended here, stdout when NULL
+    PerfHistogram windows[2][PERF_STAGE_COUNT];     // Current and previous window
+    int current;
+    uint64_t window_start_ms;
+    uint64_t stage_ns[PERF_STAGE_COUNT];    // Accumulated for the frame in flight
+    uint64_t unpresented_input_us;  // Newest device sample not yet on screen, 0 for none
+    uint64_t frame_start_ns;
+    uint64_t frames, missed_deadlines;
+    uint32_t history_us[PERF_HUD_SAMPLES];  // Frame times for the HUD graph
+    int history_pos;
+} PerfStats;
+
+// An app's last frame while it is in the background. app_buffer holds the
+// foreground app's pixels; every other open app keeps its own here.
+typedef struct {
+    uint32_t *runs;             // (length, pixel) pairs, or raw pixels; NULL if evicted
+    size_t bytes;
+    int raw;                    // Didn't compress: runs holds a plain copy
+    DisplayList list;           // What the pixels were rasterized from
+    uint64_t last_used;
+} AppSurface;
+
+typedef struct {
+    AppSurface surfaces[MAX_APPS];
+    int owner;                  // App whose pixels app_buffer holds, -1 for none
+    size_t used, budget;        // Bytes held by background surfaces
+    uint64_t clock;
+    uint64_t restores, rerenders, evictions;
+} SurfacePool;
+
+// Downscaled capture of an app's last foreground frame
+typedef struct {
+    uint32_t *pixels;
+    int w, h;
+    int valid;
+} AppSnapshot;
+
+// Maps animation progress 0..1 to eased progress
+typedef float (*EasingCurve)(float t);
+
+// One property moving towards a target, either on a critically damped spring
+// (omega > 0) or along an easing curve over a fixed duration
+typedef struct {
+    float *value;               // Property being driven, NULL for a free slot
+    float target;
+    float velocity;             // Units per second, kept when the animation is retargeted
+    float precision;            // Settled once this close to target and moving slower
+    float omega;                // Spring natural frequency in rad/s, 0 when eased
+    float from;                 // Eased: value at start_us
+    uint64_t start_us, duration_us;
+    EasingCurve curve;
+    void (*done)(void);         // Runs once the value settles on target
+} Animation;
+
+typedef struct {
+    Animation slots[MAX_ANIMATIONS];
+    int active;
+    uint64_t now_us;            // Time the values were last advanced to
+} AnimationSet;
+
+// What woke the main loop
+typedef struct {
+    int frame_ticks;            // Frame timer expirations since the last wait
+    int woken;                  // wake_main_loop was called
+} LoopEvents;
+
+typedef struct {
+    int codepoint, font_size;
+    int advance;                // Scaled advance in pixels
+    int x0, y0, w, h;           // Bitmap box relative to pen position and baseline
+    int shelf;                  // Atlas shelf holding the coverage, -1 if not resident,
+                                // GLYPH_SHELF_PACKED if it lives in the glyph pack
+    uint32_t generation;        // Shelf generation the coverage was written in
+    int atlas_x, atlas_y;
+    int next;                   // Hash chain
+} Glyph;
+
+typedef struct {
+    int y, height, used_w;
+    uint32_t generation;
+    uint64_t last_used;
+} GlyphShelf;
+
+typedef struct {
+    unsigned char *atlas;
+    int atlas_h;
+    GlyphShelf *shelves;
+    int num_shelves, max_shelves;
+    int shelf_bottom;           // First atlas row not yet claimed by a shelf
+    Glyph glyphs[GLYPH_MAX_GLYPHS];
+    int num_glyphs;
+    int buckets[GLYPH_HASH_SIZE];
+    uint64_t clock;
+    uint64_t hits, misses, rasterized, shelf_evictions, flushes;
+} GlyphCache;
+
+typedef struct {
+    int codepoint;
+    int x;                      // Pen position relative to the start of the run
+} LayoutGlyph;
+
+// A string decoded from UTF-8, kerned and positioned at one size
+typedef struct {
+    uint64_t hash;
+    int font_size;
+    char *text;                 // Owned copy, compared on hash matches; NULL if the slot is empty
+    int width;                  // Total advance
+    int baseline;               // Baseline offset from the top of the run
+    Rect ink;                   // Union of glyph boxes, relative to the run's top-left
+    LayoutGlyph *glyphs;
+    int count, capacity;
+    uint64_t last_used;
+} TextLayout;
+
+typedef struct {
+    TextLayout slots[TEXT_LAYOUT_CACHE_SIZE];   // Set s is slots[s * TEXT_LAYOUT_WAYS ...]
+    uint64_t clock;
+    uint64_t hits, misses, evictions;
+} TextLayoutCache;
+
+// On-disk glyph pack: header, GLYPH_PACK_SIZES * GLYPH_PACK_COUNT records and
+// a GLYPH_ATLAS_WIDTH wide coverage atlas. The checksum covers everything
+// after the header; the font's size and mtime tie the pack to one font file.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t atlas_w, atlas_h;
+    uint32_t sizes[GLYPH_PACK_SIZES];
+    uint32_t first_codepoint, num_codepoints;
+    uint64_t font_bytes;
+    int64_t font_mtime_ns;
+    uint64_t checksum;
+} GlyphPackHeader;
+
+typedef struct {
+    int32_t advance, x0, y0, w, h, atlas_x, atlas_y;
+} PackedGlyph;
+
+typedef struct {
+    void *map;                  // Whole file, shared read-only with the page cache
+    size_t map_bytes;
+    const unsigned char *atlas;
+    int sizes[GLYPH_PACK_SIZES];
+    Glyph glyphs[GLYPH_PACK_SIZES * GLYPH_PACK_COUNT];
+    int loaded;
+} GlyphPack;
+
+// Apps discovered in APPS_DIR, in name order
+App apps[MAX_APPS];
+int num_apps = 0;
+int calling_app = -1;           // App whose module code is running on the UI thread
+int foreground_app = -1;        // App that was last resumed and not yet suspended
 
 // Global variables
 uint32_t *framebuffer = NULL, *backbuffer = NULL, *app_buffer = NULL;
 int fb_fd, screen_w, screen_h, stride;
-TouchDevice touch_devices[16];
-int num_touch_devices = 0;
-TouchState touch = {0};
+TouchDevice touch_devices[MAX_TOUCH_DEVICES];   // Owned by the input thread once it runs
+TouchState touch = {.primary_slot = -1};
+TouchContact touch_contacts[MAX_TOUCH_SLOTS];
+int predict_ms = PREDICT_DEFAULT_MS;    // --predict, 0 draws drags at the latched position
+uint64_t present_lead_us = 0;           // Running average of frame start to presented
+InputRing input_ring;
+pthread_t input_thread;
+int input_epoll_fd = -1, input_inotify_fd = -1;
 AppState current_state = HOME_SCREEN;
 AppState animation_target_state = HOME_SCREEN;
 int current_app = -1;
 int battery_level = 87;
 float current_scale = 1.0f;
-float target_scale = 1.0f;
-int is_animating = 0;
+float window_dx = 0, window_dy = 0;    // Scaled window's anchor, relative to screen center
+AnimationSet animations;
 stbtt_fontinfo font;
+GlyphCache glyph_cache;
+GlyphPack glyph_pack;
+TextLayoutCache text_layouts;
+
+// Damage tracking state
+DamageList invalid_region;  // Areas that must be re-rendered next frame
+DamageList drawn_region;    // Areas written to the backbuffer this frame
+__thread Rect clip_rect;    // Primitives only touch pixels inside this rect
+__thread int tile_worker;   // Replaying a tile: no damage records, read-only glyph cache
+PixelKernels pixel_kernels; // Fastest kernel set this CPU supports
+RenderPool render_pool;
+int render_threads = 0;     // --threads, 0 for one per online CPU
+TileBins tile_bins;
+JobPool job_pool;
+BlurCache blur_cache;
+WindowScaler window_scaler;
+int epoll_fd = -1, frame_timer_fd = -1, wake_fd = -1;
+Presenter presenter;
+int frame_timer_armed = 0;
+ScaleFilter window_scale_filter = SCALE_BILINEAR;
+DisplayList *recording_list = NULL;
+DisplayList shell_lists[2];     // shell_lists[shell_list] is what the screen shows
+int shell_list = 0;
+DisplayList app_lists[2];       // app_lists[app_list] is what app_buffer holds
+int app_list = 0;
+int headless = 0;               // No framebuffer or input devices, time is scripted
+uint64_t headless_clock_ms = 0;
+time_t fixed_clock = 0;         // Non-zero pins the status bar clock
+PerfStats perf;
+volatile sig_atomic_t perf_dump_requested = 0, perf_hud_toggle_requested = 0;
 
 // App switcher state
-int open_apps[12];  // Track which apps are open (1 = open, 0 = closed)
+int open_apps[MAX_APPS];  // Track which apps are open (1 = open, 0 = closed)
 int num_open_apps = 0;
+AppSnapshot app_snapshots[MAX_APPS];
+SurfacePool surface_pool = {.owner = -1, .budget = SURFACE_BUDGET_BYTES};
+int composited_app = -1;        // App whose surface the last frame was copied from
 
 // Function declarations
 uint64_t get_time_ms(void);
+time_t shell_time(void);
 void get_current_time(char *time_str, char *date_str);
 void draw_status_bar(uint32_t *buf);
 int is_touching_home_indicator(int touch_x, int touch_y);
@@ -89,700 +662,4819 @@ void add_open_app(int app_id);
 void remove_open_app(int app_id);
 AppState get_home_gesture_target(AppState current);
 float calculate_scale_from_drag(int drag_distance);
-int is_quick_swipe_up(int start_x, int start_y, int end_x, int end_y, uint64_t duration);
-void apply_fast_blur(uint32_t *buf, float blur_amount);
+int is_flick_up(int start_x, int start_y, int end_x, int end_y, float vx, float vy);
+void init_render_pool(int num_threads);
+void render_pool_set_active(int n);
+void parallel_range(RangeTask task, void *ctx, int count);
+void init_job_pool(void);
+int run_completed_jobs(void);
+void init_blur_cache(void);
+void blur_cache_invalidate(void);
+const DisplayList *record_home_screen(void);
+void draw_blurred_home(uint32_t *buf, float blur_amount);
+void init_window_scaler(void);
 void draw_scaled_window(uint32_t *dest, uint32_t *src, float scale, int finger_x, int finger_y);
 void draw_home_screen(uint32_t *buf);
 void draw_app_screen(uint32_t *buf);
 void draw_app_switcher(uint32_t *buf);
+void animate_spring(float *value, float target, float omega, float precision, void (*done)(void));
+void animate_ease(float *value, float target, int duration_ms, EasingCurve curve, void (*done)(void));
+void animation_fling(float *value, float velocity);
+float animation_stop(float *value);
+int animations_active(void);
 void update_animations(void);
 void handle_touch_input(void);
+void apply_touch_frame(int x, int y, int pressed, uint64_t time_ms);
 void init_touch_devices(void);
-void read_touch_events(void);
+void init_input_thread(void);
+int read_touch_events(void);
+void input_ring_print_stats(void);
+void init_event_loop(void);
+void set_frame_timer(int active);
+int ms_until_next_minute(void);
+LoopEvents wait_for_events(int timeout_ms);
 void cleanup_and_exit(int sig);
-void handle_test_app_touch(int touch_x, int touch_y, int is_pressed, int was_pressed);
+void discover_apps(const char *dir);
+void surface_release(int app_id);
+void surface_pool_print_stats(FILE *out);
+void damage_add(DamageList *list, int x, int y, int w, int h);
+void damage_record(uint32_t *buf, int x, int y, int w, int h);
+void invalidate_rect(int x, int y, int w, int h);
+void invalidate_screen(void);
+void dl_begin(DisplayList *list);
+void dl_end(void);
+void dl_execute(const DisplayList *list, uint32_t *buf);
+int dl_diff(const DisplayList *old, const DisplayList *new, DamageList *damage);
+int dl_equal(const DisplayList *a, const DisplayList *b);
+void record_screen(DisplayList *list, AppState state);
+void window_scaler_source_changed(void);
+void render_frame(uint32_t *buf);
+void capture_app_snapshot(void);
+int draw_invalid_region(void);
+void perf_begin_frame(void);
+void perf_end_frame(int drew);
+void perf_dump(FILE *out);
+void perf_handle_requests(void);
+void draw_perf_hud(uint32_t *buf);
+int run_headless(int width, int height, const char *script, const char *out_dir, int compare);
+void init_pixel_kernels(void);
+int test_pixel_kernels(void);
+void init_presenter(void);
+void init_memory_presenter(int width, int height);
+void presenter_begin_frame(void);
+void present_frame(void);
+void present_damage(void);
+void shutdown_presenter(void);
+void glyph_cache_init(size_t max_bytes);
+void glyph_cache_flush(void);
+const Glyph *glyph_cache_get(int codepoint, int font_size);
+void glyph_cache_print_stats(void);
+
+// Microseconds on the clock touch samples are stamped with
+static uint64_t input_clock_us(void) {
+    if (headless) return headless_clock_ms * 1000;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
 uint64_t get_time_ms(void) {
+    if (headless) return headless_clock_ms;
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000ULL;
 }
 
-void clear_screen(uint32_t *buf, uint32_t color) {
-    for (int i = 0; i < screen_w * screen_h; i++) {
-        buf[i] = color;
-    }
+// Stage probes: a disabled probe is one predictable branch, or nothing with PERF_STATS=0
+#if PERF_STATS
+#define perf_active() (perf.enabled)
+#else
+#define perf_active() 0
+#endif
+
+static inline uint64_t perf_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-void draw_rect(uint32_t *buf, int x, int y, int w, int h, uint32_t color) {
+static inline uint64_t perf_begin(void) {
+    return perf_active() ? perf_now_ns() : 0;
+}
+
+static inline void perf_end(PerfStage stage, uint64_t start) {
+    if (perf_active() && start) perf.stage_ns[stage] += perf_now_ns() - start;
+}
+
+// Intersect a rect with the current clip, returns 0 if nothing is left
+static int clip_rect_to_clip(int *x, int *y, int *w, int *h) {
+    int x1 = *x + *w, y1 = *y + *h;
+    if (*x < clip_rect.x) *x = clip_rect.x;
+    if (*y < clip_rect.y) *y = clip_rect.y;
+    if (x1 > clip_rect.x + clip_rect.w) x1 = clip_rect.x + clip_rect.w;
+    if (y1 > clip_rect.y + clip_rect.h) y1 = clip_rect.y + clip_rect.h;
+    *w = x1 - *x;
+    *h = y1 - *y;
+    return *w > 0 && *h > 0;
+}
+
+static int rects_overlap(Rect a, Rect b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+static int rects_touch(Rect a, Rect b) {
+    return a.x <= b.x + b.w && b.x <= a.x + a.w && a.y <= b.y + b.h && b.y <= a.y + a.h;
+}
+
+static Rect rect_union(Rect a, Rect b) {
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+    int y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+    return (Rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+// Add a rect to a damage list, merging it with anything it touches.
+// When the list is full the rect is folded into the entry that grows least.
+void damage_add(DamageList *list, int x, int y, int w, int h) {
     if (x < 0) { w += x; x = 0; }
     if (y < 0) { h += y; y = 0; }
     if (x + w > screen_w) w = screen_w - x;
     if (y + h > screen_h) h = screen_h - y;
+    if (w <= 0 || h <= 0) return;
     
-    for (int dy = 0; dy < h; dy++) {
-        for (int dx = 0; dx < w; dx++) {
-            buf[(y + dy) * screen_w + (x + dx)] = color;
+    Rect r = {x, y, w, h};
+    int merged = 1;
+    while (merged) {
+        merged = 0;
+        for (int i = 0; i < list->count; i++) {
+            if (rects_touch(r, list->rects[i])) {
+                r = rect_union(r, list->rects[i]);
+                list->rects[i] = list->rects[--list->count];
+                merged = 1;
+                break;
+            }
         }
     }
-}
-
-void draw_circle_filled(uint32_t *buf, int cx, int cy, int radius, uint32_t color) {
-    for (int y = -radius; y <= radius; y++) {
-        for (int x = -radius; x <= radius; x++) {
-            if (x*x + y*y <= radius*radius) {
-                int px = cx + x, py = cy + y;
-                if (px >= 0 && px < screen_w && py >= 0 && py < screen_h) {
-                    buf[py * screen_w + px] = color;
-                }
-            }
+    
+    if (list->count < MAX_DAMAGE_RECTS) {
+        list->rects[list->count++] = r;
+        return;
+    }
+    
+    int best = 0;
+    long best_growth = -1;
+    for (int i = 0; i < list->count; i++) {
+        Rect u = rect_union(r, list->rects[i]);
+        long growth = (long)u.w * u.h - (long)list->rects[i].w * list->rects[i].h;
+        if (best_growth < 0 || growth < best_growth) {
+            best = i;
+            best_growth = growth;
         }
     }
+    Rect u = rect_union(r, list->rects[best]);
+    list->rects[best] = list->rects[--list->count];
+    damage_add(list, u.x, u.y, u.w, u.h);
 }
 
-void draw_rounded_rect(uint32_t *buf, int x, int y, int w, int h, int radius, uint32_t color) {
-    draw_rect(buf, x + radius, y, w - 2*radius, h, color);
-    draw_rect(buf, x, y + radius, w, h - 2*radius, color);
-    draw_circle_filled(buf, x + radius, y + radius, radius, color);
-    draw_circle_filled(buf, x + w - radius, y + radius, radius, color);
-    draw_circle_filled(buf, x + radius, y + h - radius, radius, color);
-    draw_circle_filled(buf, x + w - radius, y + h - radius, radius, color);
+// Note pixels written to the backbuffer so present_damage copies them out
+void damage_record(uint32_t *buf, int x, int y, int w, int h) {
+    if (buf != backbuffer || tile_worker) return;
+    if (!clip_rect_to_clip(&x, &y, &w, &h)) return;
+    damage_add(&drawn_region, x, y, w, h);
 }
 
-int measure_text_width(const char *text, int font_size) {
-    float scale = stbtt_ScaleForPixelHeight(&font, font_size);
-    int width = 0;
-    for (const char *p = text; *p; p++) {
-        int advance;
-        stbtt_GetCodepointHMetrics(&font, *p, &advance, NULL);
-        width += (int)(advance * scale);
+void invalidate_rect(int x, int y, int w, int h) {
+    damage_add(&invalid_region, x, y, w, h);
+}
+
+void invalidate_screen(void) {
+    invalid_region.count = 0;
+    damage_add(&invalid_region, 0, 0, screen_w, screen_h);
+}
+
+// ---------------------------------------------------------------------------
+// Pixel kernels
+//
+// Every kernel works on one run of ARGB8888 pixels. The scalar set is the
+// reference: SIMD sets must produce bit-identical output, which
+// test_pixel_kernels checks. Blending is premultiplied source-over: with the
+// source alpha scaled by coverage as s = (A*a + 127) / 255, every channel
+// becomes (c*a + d*(255-s) + 127) / 255. Divides are done as
+// (x + 1 + (x >> 8)) >> 8 so they fit in 16-bit lanes. For an opaque color this
+// is the plain coverage lerp.
+//
+// Conversion kernels write panel formats at present time. Reducing a channel
+// to 5 or 6 bits first adds a 4x4 ordered dither offset, saturating, chosen by
+// screen position so converting a damage rect matches converting the screen.
+// ---------------------------------------------------------------------------
+
+static inline uint32_t div255(uint32_t x) {
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+// Bayer matrix, indexed [y & 3][x & 3]; an offset of d / 16 of a quantization step
+static const uint8_t bayer4[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5},
+};
+
+// Per-channel dither bytes for the pixel at (x, y): d/2 for 5-bit red and blue,
+// d/4 for 6-bit green, laid out like an ARGB8888 pixel
+static inline uint32_t dither565(int x, int y) {
+    uint32_t d = bayer4[y & 3][x & 3];
+    return (d >> 1) << 16 | (d >> 2) << 8 | (d >> 1);
+}
+
+static inline uint32_t premultiply(uint32_t color) {
+    uint32_t a = color >> 24;
+    if (a == 255) return color;
+    return a << 24 | div255(((color >> 16) & 0xFF) * a + 127) << 16 |
+           div255(((color >> 8) & 0xFF) * a + 127) << 8 | div255((color & 0xFF) * a + 127);
+}
+
+static int kernels_always_supported(void) {
+    return 1;
+}
+
+static void fill_scalar(uint32_t *dst, uint32_t color, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = color;
     }
-    return width;
 }
 
-void draw_text(uint32_t *buf, const char *text, int font_size, int x, int y, uint32_t color) {
-    float text_scale = stbtt_ScaleForPixelHeight(&font, font_size);
-    int ascent, descent, line_gap;
-    stbtt_GetFontVMetrics(&font, &ascent, &descent, &line_gap);
-    int baseline = y + (int)(ascent * text_scale);
-    
-    int pos_x = x;
-    for (const char *p = text; *p; p++) {
-        int advance, left_bearing;
-        stbtt_GetCodepointHMetrics(&font, *p, &advance, &left_bearing);
-        
-        int c_x1, c_y1, c_x2, c_y2;
-        stbtt_GetCodepointBitmapBox(&font, *p, text_scale, text_scale, &c_x1, &c_y1, &c_x2, &c_y2);
+static void darken_scalar(uint32_t *dst, int amount, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t pixel = dst[i];
+        int r = ((pixel >> 16) & 0xFF);
+        int g = ((pixel >> 8) & 0xFF);
+        int b = (pixel & 0xFF);
         
-        int bitmap_w = c_x2 - c_x1;
-        int bitmap_h = c_y2 - c_y1;
+        r = (r > amount) ? r - amount : 0;
+        g = (g > amount) ? g - amount : 0;
+        b = (b > amount) ? b - amount : 0;
         
-        if (bitmap_w > 0 && bitmap_h > 0) {
-            unsigned char *bitmap = malloc(bitmap_w * bitmap_h);
-            stbtt_MakeCodepointBitmap(&font, bitmap, bitmap_w, bitmap_h, bitmap_w, text_scale, text_scale, *p);
-            
-            for (int row = 0; row < bitmap_h; row++) {
-                for (int col = 0; col < bitmap_w; col++) {
-                    unsigned char alpha = bitmap[row * bitmap_w + col];
-                    if (alpha > 128) {
-                        int px = pos_x + c_x1 + col;
-                        int py = baseline + c_y1 + row;
-                        if (px >= 0 && px < screen_w && py >= 0 && py < screen_h) {
-                            buf[py * screen_w + px] = color;
-                        }
-                    }
-                }
-            }
-            free(bitmap);
+        dst[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+static void copy_scalar(uint32_t *dst, const uint32_t *src, int count) {
+    memcpy(dst, src, count * sizeof(uint32_t));
+}
+
+// color must be premultiplied
+static void blend_scalar(uint32_t *dst, uint32_t color, const uint8_t *coverage, int count) {
+    uint32_t alpha = color >> 24;
+    for (int i = 0; i < count; i++) {
+        uint32_t a = coverage[i], inv = 255 - div255(alpha * a + 127), d = dst[i], out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t c = (color >> shift) & 0xFF, o = (d >> shift) & 0xFF;
+            out |= div255(c * a + o * inv + 127) << shift;
         }
-        pos_x += (int)(advance * text_scale);
+        dst[i] = out;
     }
 }
 
-void draw_text_centered(uint32_t *buf, const char *text, int font_size, int y, uint32_t color) {
-    int text_width = measure_text_width(text, font_size);
-    int x = (screen_w - text_width) / 2;
-    draw_text(buf, text, font_size, x, y, color);
+static inline uint32_t add_sat8(uint32_t c, uint32_t d) {
+    return c + d > 255 ? 255 : c + d;
 }
 
-void get_current_time(char *time_str, char *date_str) {
-    time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
-    if (time_str) strftime(time_str, 32, "%H:%M", tm);
-    if (date_str) strftime(date_str, 64, "%A, %B %d", tm);
+static inline uint16_t pack565(uint32_t pixel, uint32_t dither, int swap) {
+    uint32_t r = add_sat8((pixel >> 16) & 0xFF, (dither >> 16) & 0xFF) >> 3;
+    uint32_t g = add_sat8((pixel >> 8) & 0xFF, (dither >> 8) & 0xFF) >> 2;
+    uint32_t b = add_sat8(pixel & 0xFF, dither & 0xFF) >> 3;
+    return swap ? b << 11 | g << 5 | r : r << 11 | g << 5 | b;
 }
 
-void draw_status_bar(uint32_t *buf) {
-    char time_str[32];
-    get_current_time(time_str, NULL);
-    draw_text_centered(buf, time_str, MEDIUM_TEXT, 25, COLOR_WHITE);
-    
-    // Battery indicator
-    int bat_x = screen_w - 200, bat_y = 25;
-    int bat_w = 80, bat_h = 40;
-    
-    draw_rounded_rect(buf, bat_x, bat_y, bat_w, bat_h, 8, COLOR_WHITE);
-    draw_rounded_rect(buf, bat_x + 3, bat_y + 3, bat_w - 6, bat_h - 6, 5, COLOR_BG);
-    draw_rounded_rect(buf, bat_x + bat_w, bat_y + 12, 8, 16, 4, COLOR_WHITE);
-    
-    int fill_width = (int)((bat_w - 6) * battery_level / 100.0f);
-    uint32_t fill_color = battery_level > 20 ? COLOR_GREEN : COLOR_RED;
-    if (fill_width > 0) {
-        draw_rounded_rect(buf, bat_x + 3, bat_y + 3, fill_width, bat_h - 6, 5, fill_color);
+static void to_rgb565_scalar(void *dst, const uint32_t *src, int count, int x, int y) {
+    uint16_t *out = dst;
+    for (int i = 0; i < count; i++) {
+        out[i] = pack565(src[i], dither565(x + i, y), 0);
     }
-    
-    char bat_text[8];
-    snprintf(bat_text, sizeof(bat_text), "%d%%", battery_level);
-    draw_text(buf, bat_text, SMALL_TEXT, bat_x - 100, bat_y + 5, COLOR_WHITE);
-    
-    // Cellular bars
-    int bars_bottom = 65;
-    for (int i = 0; i < 4; i++) {
-        int bar_h = 12 + i * 8;
-        int bar_y = bars_bottom - bar_h;
-        draw_rect(buf, 80 + i * 20, bar_y, 12, bar_h, COLOR_WHITE);
+}
+
+static void to_bgr565_scalar(void *dst, const uint32_t *src, int count, int x, int y) {
+    uint16_t *out = dst;
+    for (int i = 0; i < count; i++) {
+        out[i] = pack565(src[i], dither565(x + i, y), 1);
     }
 }
 
-int is_touching_home_indicator(int touch_x, int touch_y) {
-    int bar_center_x = screen_w / 2;
-    int bar_y_start = screen_h - 80;  // Where the bar starts
-    int bar_width = 200;
-    int bar_extended_width = 280;  // Extended hitbox
-    
-    // Check if touch is within the horizontal bounds
-    int x_in_range = (touch_x >= (bar_center_x - bar_extended_width/2)) && 
-                     (touch_x <= (bar_center_x + bar_extended_width/2));
-    
-    // Check if touch is from the bar position down to bottom edge
-    int y_in_range = (touch_y >= bar_y_start);
-    
-    return x_in_range && y_in_range;
+static void to_xbgr8888_scalar(void *dst, const uint32_t *src, int count, int x, int y) {
+    uint32_t *out = dst;
+    for (int i = 0; i < count; i++) {
+        uint32_t p = src[i];
+        out[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+    }
 }
 
-void add_open_app(int app_id) {
-    if (app_id >= 0 && app_id < APP_COUNT && !open_apps[app_id]) {
-        open_apps[app_id] = 1;
-        num_open_apps++;
-        printf("📱 Opened app: %s (total open: %d)\n", apps[app_id].name, num_open_apps);
+#ifdef HAVE_X86_KERNELS
+static int sse2_supported(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int avx2_supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("sse2")))
+static void fill_sse2(uint32_t *dst, uint32_t color, int count) {
+    __m128i c = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i *)(dst + i), c);
     }
+    fill_scalar(dst + i, color, count - i);
 }
 
-void remove_open_app(int app_id) {
-    if (app_id >= 0 && app_id < APP_COUNT && open_apps[app_id]) {
-        open_apps[app_id] = 0;
-        num_open_apps--;
-        printf("❌ Closed app: %s (total open: %d)\n", apps[app_id].name, num_open_apps);
+__attribute__((target("sse2")))
+static void darken_sse2(uint32_t *dst, int amount, int count) {
+    __m128i sub = _mm_set1_epi32(amount * 0x010101);
+    __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_subs_epu8(p, sub), alpha));
     }
+    darken_scalar(dst + i, amount, count - i);
 }
 
-AppState get_home_gesture_target(AppState current) {
-    switch (current) {
-        case APP_SCREEN:
-            return HOME_SCREEN;
-        case HOME_SCREEN:
-            return (num_open_apps > 0) ? APP_SWITCHER : HOME_SCREEN;
-        case APP_SWITCHER:
-            return HOME_SCREEN;
-        default:
-            return current;
+__attribute__((target("sse2")))
+static void copy_sse2(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), b);
     }
+    copy_scalar(dst + i, src + i, count - i);
 }
 
-float calculate_scale_from_drag(int drag_distance) {
-    if (drag_distance < 20) return 1.0f;
-    
-    // Linear scaling that goes from 1.0 to a minimum scale
-    float max_drag = screen_h - 120; // Full screen drag distance
-    float min_scale = 0.15f; // Small enough to leave margin at top when finger is at top
-    
-    float normalized = (drag_distance - 20) / max_drag;
+// Blend 8 16-bit channels: (c*a + d*(255-s) + 127) / 255, s = (A*a + 127) / 255
+__attribute__((target("sse2")))
+static inline __m128i div255_sse2(__m128i x) {
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i blend_lanes_sse2(__m128i c, __m128i d, __m128i a, __m128i alpha) {
+    __m128i s = div255_sse2(_mm_add_epi16(_mm_mullo_epi16(alpha, a), _mm_set1_epi16(127)));
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), s);
+    __m128i x = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(c, a), _mm_mullo_epi16(d, inv)), _mm_set1_epi16(127));
+    x = _mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8));
+    return _mm_srli_epi16(x, 8);
+}
+
+__attribute__((target("sse2")))
+static void blend_sse2(uint32_t *dst, uint32_t color, const uint8_t *coverage, int count) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i c = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+    __m128i alpha = _mm_set1_epi16(color >> 24);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t m;
+        memcpy(&m, coverage + i, 4);
+        __m128i a = _mm_cvtsi32_si128((int)m);
+        a = _mm_unpacklo_epi8(a, a);
+        a = _mm_unpacklo_epi16(a, a);          // a0 a0 a0 a0 a1 a1 ... as bytes
+        __m128i a_lo = _mm_unpacklo_epi8(a, zero);
+        __m128i a_hi = _mm_unpackhi_epi8(a, zero);
+        
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = blend_lanes_sse2(c, _mm_unpacklo_epi8(d, zero), a_lo, alpha);
+        __m128i hi = blend_lanes_sse2(c, _mm_unpackhi_epi8(d, zero), a_hi, alpha);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    blend_scalar(dst + i, color, coverage + i, count - i);
+}
+
+// Dither, then pack four pixels to 565 in the low half of each 32-bit lane,
+// sign-extended so _mm_packs_epi32 narrows it unchanged
+__attribute__((target("sse2")))
+static inline __m128i pack565_sse2(__m128i p, __m128i dither, int swap) {
+    p = _mm_adds_epu8(p, dither);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07E0));
+    __m128i hi = swap ? _mm_slli_epi32(p, 8) : _mm_srli_epi32(p, 8);
+    __m128i lo = swap ? _mm_srli_epi32(p, 19) : _mm_srli_epi32(p, 3);
+    __m128i v = _mm_or_si128(_mm_or_si128(_mm_and_si128(hi, _mm_set1_epi32(0xF800)), g),
+                             _mm_and_si128(lo, _mm_set1_epi32(0x001F)));
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+__attribute__((target("sse2")))
+static void to_565_sse2(uint16_t *out, const uint32_t *src, int count, int x, int y, int swap) {
+    // The pattern repeats every four pixels, so one vector serves the whole run
+    __m128i dither = _mm_setr_epi32(dither565(x, y), dither565(x + 1, y), dither565(x + 2, y), dither565(x + 3, y));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = pack565_sse2(_mm_loadu_si128((const __m128i *)(src + i)), dither, swap);
+        __m128i b = pack565_sse2(_mm_loadu_si128((const __m128i *)(src + i + 4)), dither, swap);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+    }
+    (swap ? to_bgr565_scalar : to_rgb565_scalar)(out + i, src + i, count - i, x + i, y);
+}
+
+static void to_rgb565_sse2(void *dst, const uint32_t *src, int count, int x, int y) {
+    to_565_sse2(dst, src, count, x, y, 0);
+}
+
+static void to_bgr565_sse2(void *dst, const uint32_t *src, int count, int x, int y) {
+    to_565_sse2(dst, src, count, x, y, 1);
+}
+
+__attribute__((target("sse2")))
+static void to_xbgr8888_sse2(void *dst, const uint32_t *src, int count, int x, int y) {
+    uint32_t *out = dst;
+    __m128i keep = _mm_set1_epi32((int)0xFF00FF00), low = _mm_set1_epi32(0xFF);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(_mm_and_si128(p, keep), _mm_or_si128(r, b)));
+    }
+    to_xbgr8888_scalar(out + i, src + i, count - i, x + i, y);
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint32_t *dst, uint32_t color, int count) {
+    __m256i c = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i *)(dst + i), c);
+    }
+    fill_scalar(dst + i, color, count - i);
+}
+
+__attribute__((target("avx2")))
+static void darken_avx2(uint32_t *dst, int amount, int count) {
+    __m256i sub = _mm256_set1_epi32(amount * 0x010101);
+    __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(_mm256_subs_epu8(p, sub), alpha));
+    }
+    darken_scalar(dst + i, amount, count - i);
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 8));
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+        _mm256_storeu_si256((__m256i *)(dst + i + 8), b);
+    }
+    copy_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i div255_avx2(__m256i x) {
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_lanes_avx2(__m256i c, __m256i d, __m256i a, __m256i alpha) {
+    __m256i s = div255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(alpha, a), _mm256_set1_epi16(127)));
+    __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), s);
+    __m256i x = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(c, a), _mm256_mullo_epi16(d, inv)),
+                                 _mm256_set1_epi16(127));
+    x = _mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8));
+    return _mm256_srli_epi16(x, 8);
+}
+
+__attribute__((target("avx2")))
+static void blend_avx2(uint32_t *dst, uint32_t color, const uint8_t *coverage, int count) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+    __m256i alpha = _mm256_set1_epi16(color >> 24);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // Spread each pixel's coverage byte over its four channels
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(coverage + i)));
+        a = _mm256_mullo_epi32(a, _mm256_set1_epi32(0x01010101));
+        
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = blend_lanes_avx2(c, _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(a, zero), alpha);
+        __m256i hi = blend_lanes_avx2(c, _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(a, zero), alpha);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    blend_scalar(dst + i, color, coverage + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pack565_avx2(__m256i p, __m256i dither, int swap) {
+    p = _mm256_adds_epu8(p, dither);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07E0));
+    __m256i hi = swap ? _mm256_slli_epi32(p, 8) : _mm256_srli_epi32(p, 8);
+    __m256i lo = swap ? _mm256_srli_epi32(p, 19) : _mm256_srli_epi32(p, 3);
+    __m256i v = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(hi, _mm256_set1_epi32(0xF800)), g),
+                                _mm256_and_si256(lo, _mm256_set1_epi32(0x001F)));
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+__attribute__((target("avx2")))
+static void to_565_avx2(uint16_t *out, const uint32_t *src, int count, int x, int y, int swap) {
+    uint32_t d0 = dither565(x, y), d1 = dither565(x + 1, y), d2 = dither565(x + 2, y), d3 = dither565(x + 3, y);
+    __m256i dither = _mm256_setr_epi32(d0, d1, d2, d3, d0, d1, d2, d3);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = pack565_avx2(_mm256_loadu_si256((const __m256i *)(src + i)), dither, swap);
+        __m256i b = pack565_avx2(_mm256_loadu_si256((const __m256i *)(src + i + 8)), dither, swap);
+        // packs works per 128-bit half; put the quarters back in pixel order
+        __m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i *)(out + i), v);
+    }
+    (swap ? to_bgr565_scalar : to_rgb565_scalar)(out + i, src + i, count - i, x + i, y);
+}
+
+static void to_rgb565_avx2(void *dst, const uint32_t *src, int count, int x, int y) {
+    to_565_avx2(dst, src, count, x, y, 0);
+}
+
+static void to_bgr565_avx2(void *dst, const uint32_t *src, int count, int x, int y) {
+    to_565_avx2(dst, src, count, x, y, 1);
+}
+
+__attribute__((target("avx2")))
+static void to_xbgr8888_avx2(void *dst, const uint32_t *src, int count, int x, int y) {
+    uint32_t *out = dst;
+    __m256i swap_rb = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                       2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(p, swap_rb));
+    }
+    to_xbgr8888_scalar(out + i, src + i, count - i, x + i, y);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+static int neon_supported(void) {
+#ifdef __aarch64__
+    return 1;
+#else
+    return (getauxval(AT_HWCAP) & (1 << 12)) != 0;  // HWCAP_NEON
+#endif
+}
+
+static void fill_neon(uint32_t *dst, uint32_t color, int count) {
+    uint32x4_t c = vdupq_n_u32(color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u32(dst + i, c);
+        vst1q_u32(dst + i + 4, c);
+    }
+    fill_scalar(dst + i, color, count - i);
+}
+
+static void darken_neon(uint32_t *dst, int amount, int count) {
+    uint8x16_t sub = vreinterpretq_u8_u32(vdupq_n_u32(amount * 0x010101));
+    uint8x16_t alpha = vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint8x16_t p = vld1q_u8((const uint8_t *)(dst + i));
+        vst1q_u8((uint8_t *)(dst + i), vorrq_u8(vqsubq_u8(p, sub), alpha));
+    }
+    darken_scalar(dst + i, amount, count - i);
+}
+
+static void copy_neon(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint32x4_t a = vld1q_u32(src + i);
+        uint32x4_t b = vld1q_u32(src + i + 4);
+        vst1q_u32(dst + i, a);
+        vst1q_u32(dst + i + 4, b);
+    }
+    copy_scalar(dst + i, src + i, count - i);
+}
+
+static inline uint8x8_t blend_channel_neon(uint8x8_t c, uint8x8_t d, uint8x8_t a, uint8x8_t inv) {
+    uint16x8_t x = vmlal_u8(vmull_u8(c, a), d, inv);
+    x = vaddq_u16(x, vdupq_n_u16(127));
+    x = vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8));
+    return vshrn_n_u16(x, 8);
+}
+
+static void blend_neon(uint32_t *dst, uint32_t color, const uint8_t *coverage, int count) {
+    uint8x8_t cb = vdup_n_u8(color & 0xFF), cg = vdup_n_u8((color >> 8) & 0xFF);
+    uint8x8_t cr = vdup_n_u8((color >> 16) & 0xFF), ca = vdup_n_u8(color >> 24);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // De-interleave 8 pixels into B, G, R, A planes
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        uint8x8_t a = vld1_u8(coverage + i);
+        uint16x8_t s = vaddq_u16(vmull_u8(ca, a), vdupq_n_u16(127));
+        s = vaddq_u16(vaddq_u16(s, vdupq_n_u16(1)), vshrq_n_u16(s, 8));
+        uint8x8_t inv = vmvn_u8(vshrn_n_u16(s, 8));
+        d.val[0] = blend_channel_neon(cb, d.val[0], a, inv);
+        d.val[1] = blend_channel_neon(cg, d.val[1], a, inv);
+        d.val[2] = blend_channel_neon(cr, d.val[2], a, inv);
+        d.val[3] = blend_channel_neon(ca, d.val[3], a, inv);
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+    blend_scalar(dst + i, color, coverage + i, count - i);
+}
+
+static void to_565_neon(uint16_t *out, const uint32_t *src, int count, int x, int y, int swap) {
+    uint8_t d5[8], d6[8];
+    for (int k = 0; k < 8; k++) {
+        uint32_t d = dither565(x + k, y);
+        d5[k] = d & 0xFF;
+        d6[k] = (d >> 8) & 0xFF;
+    }
+    uint8x8_t dither5 = vld1_u8(d5), dither6 = vld1_u8(d6);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+        uint8x8_t b = vshr_n_u8(vqadd_u8(p.val[0], dither5), 3);
+        uint8x8_t g = vshr_n_u8(vqadd_u8(p.val[1], dither6), 2);
+        uint8x8_t r = vshr_n_u8(vqadd_u8(p.val[2], dither5), 3);
+        uint16x8_t hi = vshlq_n_u16(vmovl_u8(swap ? b : r), 11);
+        uint16x8_t lo = vmovl_u8(swap ? r : b);
+        vst1q_u16(out + i, vorrq_u16(vorrq_u16(hi, vshlq_n_u16(vmovl_u8(g), 5)), lo));
+    }
+    (swap ? to_bgr565_scalar : to_rgb565_scalar)(out + i, src + i, count - i, x + i, y);
+}
+
+static void to_rgb565_neon(void *dst, const uint32_t *src, int count, int x, int y) {
+    to_565_neon(dst, src, count, x, y, 0);
+}
+
+static void to_bgr565_neon(void *dst, const uint32_t *src, int count, int x, int y) {
+    to_565_neon(dst, src, count, x, y, 1);
+}
+
+static void to_xbgr8888_neon(void *dst, const uint32_t *src, int count, int x, int y) {
+    uint32_t *out = dst;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+        uint8x8_t b = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = b;
+        vst4_u8((uint8_t *)(out + i), p);
+    }
+    to_xbgr8888_scalar(out + i, src + i, count - i, x + i, y);
+}
+#endif
+
+// Best first; the scalar set must stay last as the reference and fallback
+static const PixelKernels kernel_sets[] = {
+#ifdef HAVE_X86_KERNELS
+    {"avx2", avx2_supported, fill_avx2, darken_avx2, copy_avx2, blend_avx2,
+     to_rgb565_avx2, to_bgr565_avx2, to_xbgr8888_avx2},
+    {"sse2", sse2_supported, fill_sse2, darken_sse2, copy_sse2, blend_sse2,
+     to_rgb565_sse2, to_bgr565_sse2, to_xbgr8888_sse2},
+#endif
+#ifdef HAVE_NEON_KERNELS
+    {"neon", neon_supported, fill_neon, darken_neon, copy_neon, blend_neon,
+     to_rgb565_neon, to_bgr565_neon, to_xbgr8888_neon},
+#endif
+    {"scalar", kernels_always_supported, fill_scalar, darken_scalar, copy_scalar, blend_scalar,
+     to_rgb565_scalar, to_bgr565_scalar, to_xbgr8888_scalar},
+};
+#define KERNEL_SET_COUNT (sizeof(kernel_sets)/sizeof(kernel_sets[0]))
+
+void init_pixel_kernels(void) {
+    for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+        if (kernel_sets[i].supported()) {
+            pixel_kernels = kernel_sets[i];
+            break;
+        }
+    }
+    printf("⚡ Pixel kernels: %s\n", pixel_kernels.name);
+}
+
+// Run every supported kernel set against the scalar reference on random runs
+// with odd lengths and misaligned starts. Returns the number of mismatches.
+int test_pixel_kernels(void) {
+    const PixelKernels *ref = &kernel_sets[KERNEL_SET_COUNT - 1];
+    enum { MAX_RUN = 1031, ROUNDS = 2000 };
+    uint32_t *src = malloc((MAX_RUN + 8) * 4);
+    uint32_t *expect = malloc((MAX_RUN + 8) * 4);
+    uint32_t *got = malloc((MAX_RUN + 8) * 4);
+    uint8_t *coverage = malloc(MAX_RUN + 8);
+    if (!src || !expect || !got || !coverage) { perror("Kernel test allocation failed"); exit(1); }
+    
+    int failures = 0;
+    srand(12345);
+    for (int k = 0; k < KERNEL_SET_COUNT - 1; k++) {
+        const PixelKernels *ks = &kernel_sets[k];
+        if (!ks->supported()) {
+            printf("⏭️ %s: not supported on this CPU\n", ks->name);
+            continue;
+        }
+        
+        int set_failures = 0;
+        for (int round = 0; round < ROUNDS; round++) {
+            int count = rand() % MAX_RUN;
+            int offset = rand() % 8;
+            uint32_t color = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            int amount = rand() % 256;
+            int x = rand() % 1024, y = rand() % 1024;
+            for (int i = 0; i < MAX_RUN + 8; i++) {
+                src[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+                // Bias coverage towards the 0 and 255 fast-path values
+                int r = rand() % 4;
+                coverage[i] = r == 0 ? 0 : r == 1 ? 255 : rand() % 256;
+            }
+            
+            for (int op = 0; op < 7; op++) {
+                memcpy(expect, src, (MAX_RUN + 8) * 4);
+                memcpy(got, src, (MAX_RUN + 8) * 4);
+                switch (op) {
+                    case 0: ref->fill(expect + offset, color, count); ks->fill(got + offset, color, count); break;
+                    case 1: ref->darken(expect + offset, amount, count); ks->darken(got + offset, amount, count); break;
+                    case 2: ref->copy(expect + offset, src + 3, count); ks->copy(got + offset, src + 3, count); break;
+                    case 3: ref->blend(expect + offset, premultiply(color), coverage + 5, count);
+                            ks->blend(got + offset, premultiply(color), coverage + 5, count); break;
+                    case 4: ref->to_rgb565(expect + offset, src + 3, count, x, y);
+                            ks->to_rgb565(got + offset, src + 3, count, x, y); break;
+                    case 5: ref->to_bgr565(expect + offset, src + 3, count, x, y);
+                            ks->to_bgr565(got + offset, src + 3, count, x, y); break;
+                    case 6: ref->to_xbgr8888(expect + offset, src + 3, count, x, y);
+                            ks->to_xbgr8888(got + offset, src + 3, count, x, y); break;
+                }
+                if (memcmp(expect, got, (MAX_RUN + 8) * 4) != 0) set_failures++;
+            }
+        }
+        
+        printf("%s %s: %d mismatches in %d runs\n", set_failures ? "❌" : "✅", ks->name, set_failures, ROUNDS * 7);
+        failures += set_failures;
+    }
+    
+    free(src);
+    free(expect);
+    free(got);
+    free(coverage);
+    return failures;
+}
+
+void dl_begin(DisplayList *list) {
+    list->used = 0;
+    list->count = 0;
+    list->valid = 0;
+    recording_list = list;
+}
+
+void dl_end(void) {
+    recording_list->valid = 1;
+    recording_list = NULL;
+}
+
+// Append a zeroed command with room for payload bytes after it
+static DisplayCmd *dl_push(DisplayOp op, size_t payload, Rect bounds) {
+    DisplayList *list = recording_list;
+    size_t size = sizeof(DisplayCmd) + ((payload + 7) & ~(size_t)7);
+    if (list->used + size > list->capacity) {
+        size_t capacity = list->capacity ? list->capacity : DL_INITIAL_BYTES;
+        while (capacity < list->used + size) capacity *= 2;
+        uint8_t *arena = realloc(list->arena, capacity);
+        if (!arena) { perror("Display list allocation failed"); exit(1); }
+        list->arena = arena;
+        list->capacity = capacity;
+    }
+    
+    DisplayCmd *cmd = (DisplayCmd *)(list->arena + list->used);
+    memset(cmd, 0, size);
+    cmd->op = op;
+    cmd->size = size;
+    cmd->bounds = bounds;
+    list->used += size;
+    list->count++;
+    return cmd;
+}
+
+static void dl_record_shape(DisplayOp op, int x, int y, int w, int h, int radius,
+                            uint32_t color, int antialias, Rect bounds) {
+    DisplayCmd *cmd = dl_push(op, 0, bounds);
+    cmd->x = x;
+    cmd->y = y;
+    cmd->w = w;
+    cmd->h = h;
+    cmd->radius = radius;
+    cmd->color = color;
+    cmd->antialias = antialias;
+}
+
+void clear_screen(uint32_t *buf, uint32_t color) {
+    if (recording_list) {
+        dl_record_shape(DL_CLEAR, 0, 0, 0, 0, 0, color, 0, (Rect){0, 0, screen_w, screen_h});
+        return;
+    }
+    
+    int x = 0, y = 0, w = screen_w, h = screen_h;
+    if (!clip_rect_to_clip(&x, &y, &w, &h)) return;
+    damage_record(buf, x, y, w, h);
+    
+    for (int row = y; row < y + h; row++) {
+        pixel_kernels.fill(buf + row * screen_w + x, color, w);
+    }
+}
+
+void draw_rect(uint32_t *buf, int x, int y, int w, int h, uint32_t color) {
+    if (recording_list) {
+        dl_record_shape(DL_RECT, x, y, w, h, 0, color, 0, (Rect){x, y, w, h});
+        return;
+    }
+    if (!clip_rect_to_clip(&x, &y, &w, &h)) return;
+    damage_record(buf, x, y, w, h);
+    
+    for (int dy = 0; dy < h; dy++) {
+        pixel_kernels.fill(buf + (y + dy) * screen_w + x, color, w);
+    }
+}
+
+// Blend a premultiplied color through a coverage mask. Zero coverage is
+// skipped eight bytes at a time, and with an opaque color long runs of full
+// coverage become fills. Only the edges in between reach the blend kernel.
+static void blend_coverage_row(uint32_t *dst, uint32_t color, const uint8_t *coverage, int count) {
+    int opaque = color >> 24 == 255;
+    int i = 0;
+    while (i < count) {
+        uint64_t word;
+        while (i + 8 <= count && (memcpy(&word, coverage + i, 8), word == 0)) i += 8;
+        while (i < count && coverage[i] == 0) i++;
+        
+        // Covered span [start, i), then its long solid runs
+        int start = i;
+        while (i < count && coverage[i] != 0) i++;
+        int blend_from = start;
+        for (int j = start; opaque && j < i; ) {
+            if (coverage[j] != 255) {
+                j++;
+                continue;
+            }
+            int run = j;
+            while (j < i && coverage[j] == 255) j++;
+            if (j - run < 8) continue;
+            if (run > blend_from) pixel_kernels.blend(dst + blend_from, color, coverage + blend_from, run - blend_from);
+            pixel_kernels.fill(dst + run, color, j - run);
+            blend_from = j;
+        }
+        if (i > blend_from) pixel_kernels.blend(dst + blend_from, color, coverage + blend_from, i - blend_from);
+    }
+}
+
+// Blend a premultiplied color over count pixels that share one coverage value
+static void blend_uniform_span(uint32_t *dst, uint32_t color, int coverage, int count) {
+    uint8_t mask[256];
+    memset(mask, coverage, sizeof(mask));
+    for (int i = 0; i < count; i += sizeof(mask)) {
+        pixel_kernels.blend(dst + i, color, mask, count - i < (int)sizeof(mask) ? count - i : (int)sizeof(mask));
+    }
+}
+
+// Fill pixels [x0, x1) of one row, clipped once for the whole span
+static inline void fill_span(uint32_t *buf, int py, int x0, int x1, uint32_t color) {
+    if (x0 < clip_rect.x) x0 = clip_rect.x;
+    if (x1 > clip_rect.x + clip_rect.w) x1 = clip_rect.x + clip_rect.w;
+    if (x1 > x0) pixel_kernels.fill(buf + py * screen_w + x0, color, x1 - x0);
+}
+
+// Blend pixels [x0, x1) of one row with coverage from the distance to a corner center
+static void blend_corner_span(uint32_t *buf, int py, int x0, int x1, double corner_x, double dy,
+                              double radius, uint32_t color) {
+    if (x0 < clip_rect.x) x0 = clip_rect.x;
+    if (x1 > clip_rect.x + clip_rect.w) x1 = clip_rect.x + clip_rect.w;
+    uint32_t *row = buf + py * screen_w;
+    uint8_t mask[256];
+    for (int chunk = x0; chunk < x1; chunk += sizeof(mask)) {
+        int count = x1 - chunk < (int)sizeof(mask) ? x1 - chunk : (int)sizeof(mask);
+        for (int i = 0; i < count; i++) {
+            double dx = chunk + i + 0.5 - corner_x;
+            double dist = sqrt(dx * dx + dy * dy);
+            int coverage = (int)((radius - dist + 0.5) * 255.0 + 0.5);
+            mask[i] = coverage <= 0 ? 0 : coverage >= 255 ? 255 : coverage;
+        }
+        blend_coverage_row(row + chunk, color, mask, count);
+    }
+}
+
+// Scanline rasterizer for a box [x0, x1) x [y0, y1) with circular corners of the given
+// radius. Each row is resolved to at most three runs - blended left edge, solid middle,
+// blended right edge - so every covered pixel is written exactly once. Without
+// antialiasing a pixel is inside when its center is, and the edge runs are empty.
+static void fill_rounded_box(uint32_t *buf, double x0, double y0, double x1, double y1,
+                             double radius, uint32_t color, int antialias) {
+    double pad = antialias ? 0.5 : 0.0;
+    uint32_t source = premultiply(color);
+    int row_start = (int)ceil(y0 - pad - 0.5);
+    int row_end = (int)floor(y1 + pad - 0.5) + 1;
+    if (row_start < clip_rect.y) row_start = clip_rect.y;
+    if (row_end > clip_rect.y + clip_rect.h) row_end = clip_rect.y + clip_rect.h;
+    
+    double left_cx = x0 + radius, right_cx = x1 - radius;
+    double top_cy = y0 + radius, bottom_cy = y1 - radius;
+    
+    for (int py = row_start; py < row_end; py++) {
+        double yc = py + 0.5;
+        double dy = 0.0;
+        if (yc < top_cy) dy = top_cy - yc;
+        else if (yc > bottom_cy) dy = yc - bottom_cy;
+        
+        double outer = radius + pad, inner = radius - pad;
+        if (dy > outer) continue;
+        
+        double ex_out = sqrt(outer * outer - dy * dy);
+        double ex_in = dy <= inner ? sqrt(inner * inner - dy * dy) : 0.0;
+        
+        // Pixel index boundaries: [a, b) left edge, [b, c) middle, [c, d) right edge
+        int a = (int)ceil(left_cx - ex_out - 0.5);
+        int b = (int)ceil(left_cx - ex_in - 0.5);
+        int c = (int)floor(right_cx + ex_in - 0.5) + 1;
+        int d = (int)floor(right_cx + ex_out - 0.5) + 1;
+        
+        if (!antialias) {
+            fill_span(buf, py, a, d, color);
+        } else if (dy <= inner) {
+            blend_corner_span(buf, py, a, b, left_cx, dy, radius, source);
+            fill_span(buf, py, b, c, color);
+            blend_corner_span(buf, py, c, d, right_cx, dy, radius, source);
+        } else {
+            // Row grazes the top or bottom edge: the flat middle shares one coverage
+            blend_corner_span(buf, py, a, b, left_cx, dy, radius, source);
+            int coverage = (int)((radius - dy + 0.5) * 255.0 + 0.5);
+            if (coverage > 0) {
+                int m0 = b < clip_rect.x ? clip_rect.x : b;
+                int m1 = c > clip_rect.x + clip_rect.w ? clip_rect.x + clip_rect.w : c;
+                if (m1 > m0) {
+                    blend_uniform_span(buf + py * screen_w + m0, source, coverage > 255 ? 255 : coverage, m1 - m0);
+                }
+            }
+            blend_corner_span(buf, py, c, d, right_cx, dy, radius, source);
+        }
+    }
+}
+
+static void draw_circle_shape(uint32_t *buf, int cx, int cy, int radius, uint32_t color, int antialias) {
+    if (radius < 0) return;
+    if (recording_list) {
+        Rect bounds = {cx - radius, cy - radius, radius * 2 + 1, radius * 2 + 1};
+        dl_record_shape(DL_CIRCLE, cx, cy, radius, 0, 0, color, antialias, bounds);
+        return;
+    }
+    damage_record(buf, cx - radius, cy - radius, radius * 2 + 1, radius * 2 + 1);
+    
+    // Centered on the pixel center so the aliased result matches x*x + y*y <= r*r
+    double fx = cx + 0.5, fy = cy + 0.5;
+    fill_rounded_box(buf, fx - radius, fy - radius, fx + radius, fy + radius, radius, color, antialias);
+}
+
+static void draw_rounded_rect_shape(uint32_t *buf, int x, int y, int w, int h, int radius,
+                                    uint32_t color, int antialias) {
+    if (w <= 0 || h <= 0) return;
+    if (recording_list) {
+        dl_record_shape(DL_ROUNDED_RECT, x, y, w, h, radius, color, antialias, (Rect){x, y, w, h});
+        return;
+    }
+    if (radius > w / 2) radius = w / 2;
+    if (radius > h / 2) radius = h / 2;
+    if (radius < 0) radius = 0;
+    damage_record(buf, x, y, w, h);
+    
+    fill_rounded_box(buf, x, y, x + w, y + h, radius, color, antialias);
+}
+
+void draw_circle_filled(uint32_t *buf, int cx, int cy, int radius, uint32_t color) {
+    draw_circle_shape(buf, cx, cy, radius, color, 0);
+}
+
+void draw_circle_filled_aa(uint32_t *buf, int cx, int cy, int radius, uint32_t color) {
+    draw_circle_shape(buf, cx, cy, radius, color, 1);
+}
+
+void draw_rounded_rect(uint32_t *buf, int x, int y, int w, int h, int radius, uint32_t color) {
+    draw_rounded_rect_shape(buf, x, y, w, h, radius, color, 0);
+}
+
+void draw_rounded_rect_aa(uint32_t *buf, int x, int y, int w, int h, int radius, uint32_t color) {
+    draw_rounded_rect_shape(buf, x, y, w, h, radius, color, 1);
+}
+
+void glyph_cache_init(size_t max_bytes) {
+    glyph_cache.atlas_h = max_bytes / GLYPH_ATLAS_WIDTH;
+    if (glyph_cache.atlas_h < GLYPH_ATLAS_MIN_HEIGHT) glyph_cache.atlas_h = GLYPH_ATLAS_MIN_HEIGHT;
+    
+    glyph_cache.atlas = malloc((size_t)GLYPH_ATLAS_WIDTH * glyph_cache.atlas_h);
+    if (!glyph_cache.atlas) { perror("Glyph atlas allocation failed"); exit(1); }
+    
+    glyph_cache.max_shelves = glyph_cache.atlas_h / GLYPH_SHELF_ROUND;
+    glyph_cache.shelves = calloc(glyph_cache.max_shelves, sizeof(GlyphShelf));
+    if (!glyph_cache.shelves) { perror("Glyph shelf allocation failed"); exit(1); }
+    
+    glyph_cache_flush();
+    glyph_cache.flushes = 0;
+}
+
+// Drop all atlas shelves; glyph metrics stay cached and re-rasterize on next use
+static void glyph_atlas_reset(void) {
+    for (int i = 0; i < glyph_cache.num_shelves; i++) {
+        glyph_cache.shelves[i].generation++;
+    }
+    glyph_cache.num_shelves = 0;
+    glyph_cache.shelf_bottom = 0;
+    glyph_cache.flushes++;
+}
+
+void glyph_cache_flush(void) {
+    glyph_atlas_reset();
+    glyph_cache.num_glyphs = 0;
+    for (int i = 0; i < GLYPH_HASH_SIZE; i++) {
+        glyph_cache.buckets[i] = -1;
+    }
+}
+
+// Glyphs the pack holds never touch the cache, its hash table or its LRU
+static const Glyph *glyph_pack_find(int codepoint, int font_size) {
+    if (!glyph_pack.loaded || codepoint < GLYPH_PACK_FIRST || codepoint >= GLYPH_PACK_FIRST + GLYPH_PACK_COUNT) {
+        return NULL;
+    }
+    for (int i = 0; i < GLYPH_PACK_SIZES; i++) {
+        if (glyph_pack.sizes[i] == font_size) {
+            return &glyph_pack.glyphs[i * GLYPH_PACK_COUNT + codepoint - GLYPH_PACK_FIRST];
+        }
+    }
+    return NULL;
+}
+
+// Atlas coverage for a glyph, or NULL when it isn't resident
+static const unsigned char *glyph_coverage(const Glyph *g) {
+    if (g->shelf == GLYPH_SHELF_PACKED) return glyph_pack.atlas + g->atlas_y * GLYPH_ATLAS_WIDTH + g->atlas_x;
+    if (g->shelf < 0) return NULL;
+    return glyph_cache.atlas + g->atlas_y * GLYPH_ATLAS_WIDTH + g->atlas_x;
+}
+
+static unsigned glyph_hash(int codepoint, int font_size) {
+    return ((unsigned)codepoint * 2654435761u ^ (unsigned)font_size * 40503u) % GLYPH_HASH_SIZE;
+}
+
+// Pick a shelf with room for a w x h glyph, opening or evicting one if needed
+static int glyph_cache_find_shelf(int w, int h) {
+    int shelf_h = (h + GLYPH_SHELF_ROUND - 1) / GLYPH_SHELF_ROUND * GLYPH_SHELF_ROUND;
+    
+    for (int i = 0; i < glyph_cache.num_shelves; i++) {
+        GlyphShelf *shelf = &glyph_cache.shelves[i];
+        if (shelf->height == shelf_h && shelf->used_w + w <= GLYPH_ATLAS_WIDTH) return i;
+    }
+    
+    if (glyph_cache.shelf_bottom + shelf_h <= glyph_cache.atlas_h &&
+        glyph_cache.num_shelves < glyph_cache.max_shelves) {
+        GlyphShelf *shelf = &glyph_cache.shelves[glyph_cache.num_shelves];
+        shelf->y = glyph_cache.shelf_bottom;
+        shelf->height = shelf_h;
+        shelf->used_w = 0;
+        shelf->generation++;
+        glyph_cache.shelf_bottom += shelf_h;
+        return glyph_cache.num_shelves++;
+    }
+    
+    // Atlas full: recycle the least recently used shelf that is tall enough,
+    // preferring an exact height match so short glyphs don't waste tall rows
+    int victim = -1;
+    for (int pass = 0; pass < 2 && victim < 0; pass++) {
+        for (int i = 0; i < glyph_cache.num_shelves; i++) {
+            GlyphShelf *shelf = &glyph_cache.shelves[i];
+            if (pass == 0 ? shelf->height != shelf_h : shelf->height < shelf_h) continue;
+            if (victim < 0 || shelf->last_used < glyph_cache.shelves[victim].last_used) victim = i;
+        }
+    }
+    if (victim < 0) return -1;
+    
+    glyph_cache.shelves[victim].used_w = 0;
+    glyph_cache.shelves[victim].generation++;
+    glyph_cache.shelf_evictions++;
+    return victim;
+}
+
+static int glyph_cache_rasterize(Glyph *g) {
+    if (g->w > GLYPH_ATLAS_WIDTH || g->h > glyph_cache.atlas_h) return 0;
+    
+    int shelf_index = glyph_cache_find_shelf(g->w, g->h);
+    if (shelf_index < 0) {
+        // No shelf is tall enough to recycle - start over with an empty atlas
+        glyph_atlas_reset();
+        shelf_index = glyph_cache_find_shelf(g->w, g->h);
+        if (shelf_index < 0) return 0;
+    }
+    
+    GlyphShelf *shelf = &glyph_cache.shelves[shelf_index];
+    g->shelf = shelf_index;
+    g->generation = shelf->generation;
+    g->atlas_x = shelf->used_w;
+    g->atlas_y = shelf->y;
+    shelf->used_w += g->w;
+    
+    float text_scale = stbtt_ScaleForPixelHeight(&font, g->font_size);
+    stbtt_MakeCodepointBitmap(&font, glyph_cache.atlas + g->atlas_y * GLYPH_ATLAS_WIDTH + g->atlas_x,
+                              g->w, g->h, GLYPH_ATLAS_WIDTH, text_scale, text_scale, g->codepoint);
+    glyph_cache.rasterized++;
+    return 1;
+}
+
+// Look up metrics and atlas coverage for a glyph, rasterizing it on a miss.
+// The returned pointer is valid until the next call.
+const Glyph *glyph_cache_get(int codepoint, int font_size) {
+    const Glyph *packed = glyph_pack_find(codepoint, font_size);
+    if (packed) {
+        glyph_cache.hits++;
+        return packed;
+    }
+    
+    unsigned bucket = glyph_hash(codepoint, font_size);
+    Glyph *g = NULL;
+    
+    for (int i = glyph_cache.buckets[bucket]; i >= 0; i = glyph_cache.glyphs[i].next) {
+        if (glyph_cache.glyphs[i].codepoint == codepoint && glyph_cache.glyphs[i].font_size == font_size) {
+            g = &glyph_cache.glyphs[i];
+            break;
+        }
+    }
+    
+    if (!g) {
+        if (glyph_cache.num_glyphs == GLYPH_MAX_GLYPHS) glyph_cache_flush();
+        
+        float text_scale = stbtt_ScaleForPixelHeight(&font, font_size);
+        int advance, c_x1, c_y1, c_x2, c_y2;
+        stbtt_GetCodepointHMetrics(&font, codepoint, &advance, NULL);
+        stbtt_GetCodepointBitmapBox(&font, codepoint, text_scale, text_scale, &c_x1, &c_y1, &c_x2, &c_y2);
+        
+        g = &glyph_cache.glyphs[glyph_cache.num_glyphs];
+        *g = (Glyph){
+            codepoint, font_size, (int)(advance * text_scale),
+            c_x1, c_y1, c_x2 - c_x1, c_y2 - c_y1,
+            -1, 0, 0, 0, glyph_cache.buckets[bucket]
+        };
+        glyph_cache.buckets[bucket] = glyph_cache.num_glyphs++;
+    }
+    
+    glyph_cache.clock++;
+    if (g->w <= 0 || g->h <= 0) {
+        glyph_cache.hits++;
+        return g;
+    }
+    
+    if (g->shelf >= 0 && glyph_cache.shelves[g->shelf].generation == g->generation) {
+        glyph_cache.hits++;
+    } else {
+        glyph_cache.misses++;
+        if (!glyph_cache_rasterize(g)) g->shelf = -1;
+    }
+    
+    if (g->shelf >= 0) glyph_cache.shelves[g->shelf].last_used = glyph_cache.clock;
+    return g;
+}
+
+// Lookup for tile workers: never rasterizes or touches LRU state, so any number
+// of threads may call it while the main thread waits in parallel_range. Returns
+// NULL for a glyph that was never looked up or whose shelf has been recycled.
+static const Glyph *glyph_cache_peek(int codepoint, int font_size) {
+    const Glyph *packed = glyph_pack_find(codepoint, font_size);
+    if (packed) return packed;
+    
+    unsigned bucket = glyph_hash(codepoint, font_size);
+    for (int i = glyph_cache.buckets[bucket]; i >= 0; i = glyph_cache.glyphs[i].next) {
+        const Glyph *g = &glyph_cache.glyphs[i];
+        if (g->codepoint != codepoint || g->font_size != font_size) continue;
+        if (g->shelf >= 0 && glyph_cache.shelves[g->shelf].generation != g->generation) return NULL;
+        return g;
+    }
+    return NULL;
+}
+
+void glyph_cache_print_stats(void) {
+    uint64_t lookups = glyph_cache.hits + glyph_cache.misses;
+    printf("🔤 Glyph cache: %llu lookups, %.1f%% hits, %llu rasterized, %llu shelf evictions, %llu flushes\n",
+           (unsigned long long)lookups, lookups ? 100.0 * glyph_cache.hits / lookups : 0.0,
+           (unsigned long long)glyph_cache.rasterized, (unsigned long long)glyph_cache.shelf_evictions,
+           (unsigned long long)glyph_cache.flushes);
+    printf("🔤 Glyph atlas: %d/%d rows in %d shelves, %d glyphs cached\n",
+           glyph_cache.shelf_bottom, glyph_cache.atlas_h, glyph_cache.num_shelves, glyph_cache.num_glyphs);
+}
+
+// FNV-1a over 64-bit words; the last partial word is zero-padded
+static uint64_t glyph_pack_checksum(const void *data, size_t bytes) {
+    const uint64_t *words = data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < bytes / 8; i++) {
+        hash = (hash ^ words[i]) * 1099511628211ULL;
+    }
+    if (bytes % 8) {
+        uint64_t tail = 0;
+        memcpy(&tail, words + bytes / 8, bytes % 8);
+        hash = (hash ^ tail) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Map a file read-only. Pages come straight from the page cache and are
+// shared with every other process mapping the same file.
+static void *map_file(const char *path, size_t *bytes, struct stat *st) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    void *map = MAP_FAILED;
+    if (fstat(fd, st) == 0 && st->st_size > 0) {
+        map = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    *bytes = st->st_size;
+    return map;
+}
+
+static int64_t stat_mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Map the pack at PATH if it was built from this font by this version
+static int glyph_pack_load(const char *path, const struct stat *font_stat) {
+    struct stat st;
+    size_t bytes;
+    void *map = map_file(path, &bytes, &st);
+    if (!map) return 0;
+    
+    const GlyphPackHeader *header = map;
+    const PackedGlyph *records = (const PackedGlyph *)(header + 1);
+    size_t num_records = GLYPH_PACK_SIZES * GLYPH_PACK_COUNT;
+    size_t atlas_offset = sizeof(*header) + num_records * sizeof(PackedGlyph);
+    int valid = bytes >= sizeof(*header) &&
+        memcmp(header->magic, GLYPH_PACK_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == GLYPH_PACK_VERSION &&
+        header->atlas_w == GLYPH_ATLAS_WIDTH &&
+        header->first_codepoint == GLYPH_PACK_FIRST && header->num_codepoints == GLYPH_PACK_COUNT &&
+        header->font_bytes == (uint64_t)font_stat->st_size &&
+        header->font_mtime_ns == stat_mtime_ns(font_stat) &&
+        bytes == atlas_offset + (size_t)header->atlas_w * header->atlas_h &&
+        header->checksum == glyph_pack_checksum(header + 1, bytes - sizeof(*header));
+    for (int i = 0; valid && i < GLYPH_PACK_SIZES; i++) {
+        valid = header->sizes[i] == (uint32_t)(i == 0 ? LARGE_TEXT : i == 1 ? MEDIUM_TEXT : SMALL_TEXT);
+    }
+    if (!valid) {
+        munmap(map, bytes);
+        return 0;
+    }
+    
+    glyph_pack.map = map;
+    glyph_pack.map_bytes = bytes;
+    glyph_pack.atlas = (const unsigned char *)map + atlas_offset;
+    for (int i = 0; i < GLYPH_PACK_SIZES; i++) {
+        glyph_pack.sizes[i] = header->sizes[i];
+        for (int c = 0; c < GLYPH_PACK_COUNT; c++) {
+            const PackedGlyph *r = &records[i * GLYPH_PACK_COUNT + c];
+            glyph_pack.glyphs[i * GLYPH_PACK_COUNT + c] = (Glyph){
+                GLYPH_PACK_FIRST + c, glyph_pack.sizes[i], r->advance,
+                r->x0, r->y0, r->w, r->h,
+                GLYPH_SHELF_PACKED, 0, r->atlas_x, r->atlas_y, -1
+            };
+        }
+    }
+    glyph_pack.loaded = 1;
+    return 1;
+}
+
+// Rasterize the pack's glyphs exactly as glyph_cache_rasterize would, row by
+// row into one atlas, and write it to PATH. Written to a temporary name and
+// renamed so a crash never leaves a torn pack behind.
+static int glyph_pack_build(const char *path, const struct stat *font_stat) {
+    static const int sizes[GLYPH_PACK_SIZES] = {LARGE_TEXT, MEDIUM_TEXT, SMALL_TEXT};
+    size_t num_records = GLYPH_PACK_SIZES * GLYPH_PACK_COUNT;
+    PackedGlyph *records = calloc(num_records, sizeof(PackedGlyph));
+    if (!records) return 0;
+    
+    // Layout pass: left to right, a new row when the current one is full
+    int x = 0, y = 0, row_h = 0;
+    for (int i = 0; i < GLYPH_PACK_SIZES; i++) {
+        float text_scale = stbtt_ScaleForPixelHeight(&font, sizes[i]);
+        for (int c = 0; c < GLYPH_PACK_COUNT; c++) {
+            PackedGlyph *r = &records[i * GLYPH_PACK_COUNT + c];
+            int advance, c_x1, c_y1, c_x2, c_y2;
+            stbtt_GetCodepointHMetrics(&font, GLYPH_PACK_FIRST + c, &advance, NULL);
+            stbtt_GetCodepointBitmapBox(&font, GLYPH_PACK_FIRST + c, text_scale, text_scale, &c_x1, &c_y1, &c_x2, &c_y2);
+            *r = (PackedGlyph){(int)(advance * text_scale), c_x1, c_y1, c_x2 - c_x1, c_y2 - c_y1, 0, 0};
+            if (r->w <= 0 || r->h <= 0) continue;
+            if (r->w > GLYPH_ATLAS_WIDTH) r->w = 0;
+            if (x + r->w > GLYPH_ATLAS_WIDTH) {
+                x = 0;
+                y += row_h;
+                row_h = 0;
+            }
+            r->atlas_x = x;
+            r->atlas_y = y;
+            x += r->w;
+            if (r->h > row_h) row_h = r->h;
+        }
+    }
+    
+    GlyphPackHeader header = {
+        .magic = GLYPH_PACK_MAGIC, .version = GLYPH_PACK_VERSION,
+        .atlas_w = GLYPH_ATLAS_WIDTH, .atlas_h = y + row_h,
+        .first_codepoint = GLYPH_PACK_FIRST, .num_codepoints = GLYPH_PACK_COUNT,
+        .font_bytes = font_stat->st_size, .font_mtime_ns = stat_mtime_ns(font_stat)
+    };
+    size_t records_bytes = num_records * sizeof(PackedGlyph);
+    size_t atlas_bytes = (size_t)header.atlas_w * header.atlas_h;
+    unsigned char *body = calloc(1, records_bytes + atlas_bytes);
+    if (!body) {
+        free(records);
+        return 0;
+    }
+    
+    unsigned char *atlas = body + records_bytes;
+    for (int i = 0; i < GLYPH_PACK_SIZES; i++) {
+        header.sizes[i] = sizes[i];
+        float text_scale = stbtt_ScaleForPixelHeight(&font, sizes[i]);
+        for (int c = 0; c < GLYPH_PACK_COUNT; c++) {
+            const PackedGlyph *r = &records[i * GLYPH_PACK_COUNT + c];
+            if (r->w <= 0 || r->h <= 0) continue;
+            stbtt_MakeCodepointBitmap(&font, atlas + r->atlas_y * GLYPH_ATLAS_WIDTH + r->atlas_x,
+                                      r->w, r->h, GLYPH_ATLAS_WIDTH, text_scale, text_scale, GLYPH_PACK_FIRST + c);
+        }
+    }
+    memcpy(body, records, records_bytes);
+    free(records);
+    header.checksum = glyph_pack_checksum(body, records_bytes + atlas_bytes);
+    
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    int ok = f && fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(body, records_bytes + atlas_bytes, 1, f) == 1;
+    if (f && fclose(f) != 0) ok = 0;
+    free(body);
+    if (ok && rename(tmp_path, path) != 0) ok = 0;
+    if (!ok) unlink(tmp_path);
+    return ok;
+}
+
+// Load the pack for the current font, rebuilding it first if it is missing,
+// stale or corrupt. Without a pack every size falls back to the lazy cache.
+void glyph_pack_init(const char *path, const struct stat *font_stat) {
+    if (glyph_pack_load(path, font_stat)) {
+        printf("🔤 Glyph pack: %d glyphs, %zu KB mapped\n", GLYPH_PACK_SIZES * GLYPH_PACK_COUNT, glyph_pack.map_bytes / 1024);
+        return;
+    }
+    
+    uint64_t start = perf_now_ns();
+    if (!glyph_pack_build(path, font_stat) || !glyph_pack_load(path, font_stat)) {
+        fprintf(stderr, "⚠️ Glyph pack %s unavailable, rasterizing on demand\n", path);
+        return;
+    }
+    printf("🔤 Glyph pack rebuilt in %.1f ms: %zu KB\n", (perf_now_ns() - start) / 1e6, glyph_pack.map_bytes / 1024);
+}
+
+// Decode one UTF-8 sequence and advance past it. Malformed, overlong and
+// surrogate sequences decode to U+FFFD; a truncated one stops at the NUL.
+static int utf8_next(const char **text) {
+    const unsigned char *p = (const unsigned char *)*text;
+    int codepoint, len;
+    if (p[0] < 0x80) { codepoint = p[0]; len = 1; }
+    else if ((p[0] & 0xE0) == 0xC0) { codepoint = p[0] & 0x1F; len = 2; }
+    else if ((p[0] & 0xF0) == 0xE0) { codepoint = p[0] & 0x0F; len = 3; }
+    else if ((p[0] & 0xF8) == 0xF0) { codepoint = p[0] & 0x07; len = 4; }
+    else { *text += 1; return 0xFFFD; }
+    
+    for (int i = 1; i < len; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            *text += i;
+            return 0xFFFD;
+        }
+        codepoint = codepoint << 6 | (p[i] & 0x3F);
+    }
+    *text += len;
+    if ((len == 2 && codepoint < 0x80) || (len == 3 && codepoint < 0x800) ||
+        (len == 4 && (codepoint < 0x10000 || codepoint > 0x10FFFF)) ||
+        (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        return 0xFFFD;
+    }
+    return codepoint;
+}
+
+static uint64_t text_layout_hash(const char *text, int font_size) {
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)font_size;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static TextLayout *text_layout_set(uint64_t hash) {
+    return &text_layouts.slots[hash % (TEXT_LAYOUT_CACHE_SIZE / TEXT_LAYOUT_WAYS) * TEXT_LAYOUT_WAYS];
+}
+
+static TextLayout *text_layout_slot(const char *text, int font_size, uint64_t hash) {
+    TextLayout *set = text_layout_set(hash);
+    for (int i = 0; i < TEXT_LAYOUT_WAYS; i++) {
+        TextLayout *layout = &set[i];
+        if (layout->text && layout->hash == hash && layout->font_size == font_size &&
+            strcmp(layout->text, text) == 0) {
+            return layout;
+        }
+    }
+    return NULL;
+}
+
+// Lay TEXT out into LAYOUT: decode, look up glyph metrics, apply kern pairs
+// and collect the ink box. Returns 0 if memory runs out.
+static int text_layout_build(TextLayout *layout, const char *text, int font_size) {
+    float text_scale = stbtt_ScaleForPixelHeight(&font, font_size);
+    int ascent, descent, line_gap;
+    stbtt_GetFontVMetrics(&font, &ascent, &descent, &line_gap);
+    layout->baseline = (int)(ascent * text_scale);
+    layout->count = 0;
+    
+    int min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+    int pen = 0, prev = 0;
+    for (const char *p = text; *p; ) {
+        int codepoint = utf8_next(&p);
+        if (prev) pen += (int)lroundf(stbtt_GetCodepointKernAdvance(&font, prev, codepoint) * text_scale);
+        
+        if (layout->count == layout->capacity) {
+            int capacity = layout->capacity ? layout->capacity * 2 : 32;
+            LayoutGlyph *glyphs = realloc(layout->glyphs, capacity * sizeof(LayoutGlyph));
+            if (!glyphs) return 0;
+            layout->glyphs = glyphs;
+            layout->capacity = capacity;
+        }
+        layout->glyphs[layout->count++] = (LayoutGlyph){codepoint, pen};
+        
+        const Glyph *g = glyph_cache_get(codepoint, font_size);
+        if (g->w > 0 && g->h > 0) {
+            int gx = pen + g->x0, gy = layout->baseline + g->y0;
+            if (gx < min_x) min_x = gx;
+            if (gy < min_y) min_y = gy;
+            if (gx + g->w > max_x) max_x = gx + g->w;
+            if (gy + g->h > max_y) max_y = gy + g->h;
+        }
+        pen += g->advance;
+        prev = codepoint;
+    }
+    
+    layout->width = pen;
+    layout->ink = max_x > min_x ? (Rect){min_x, min_y, max_x - min_x, max_y - min_y} : (Rect){0, 0, 0, 0};
+    return 1;
+}
+
+// Cached layout of TEXT at FONT_SIZE, laying it out on a miss. Main thread
+// only; the pointer is valid until the next call.
+static const TextLayout *text_layout_get(const char *text, int font_size) {
+    uint64_t hash = text_layout_hash(text, font_size);
+    TextLayout *layout = text_layout_slot(text, font_size, hash);
+    if (layout) {
+        text_layouts.hits++;
+        layout->last_used = ++text_layouts.clock;
+        return layout;
+    }
+    
+    // Take an empty way, else the set's least recently used
+    text_layouts.misses++;
+    TextLayout *set = text_layout_set(hash);
+    layout = &set[0];
+    for (int i = 1; i < TEXT_LAYOUT_WAYS && layout->text; i++) {
+        if (!set[i].text || set[i].last_used < layout->last_used) layout = &set[i];
+    }
+    if (layout->text) text_layouts.evictions++;
+    layout->last_used = ++text_layouts.clock;
+    free(layout->text);
+    layout->text = strdup(text);
+    layout->hash = hash;
+    layout->font_size = font_size;
+    if (!layout->text || !text_layout_build(layout, text, font_size)) {
+        perror("Text layout allocation failed");
+        exit(1);
+    }
+    return layout;
+}
+
+// Read-only lookup for tile workers, like glyph_cache_peek
+static const TextLayout *text_layout_peek(const char *text, int font_size) {
+    return text_layout_slot(text, font_size, text_layout_hash(text, font_size));
+}
+
+void text_layout_print_stats(void) {
+    uint64_t lookups = text_layouts.hits + text_layouts.misses;
+    printf("🔤 Text layouts: %llu lookups, %.1f%% hits, %llu evictions\n",
+           (unsigned long long)lookups, lookups ? 100.0 * text_layouts.hits / lookups : 0.0,
+           (unsigned long long)text_layouts.evictions);
+}
+
+int measure_text_width(const char *text, int font_size) {
+    return text_layout_get(text, font_size)->width;
+}
+
+// Pixels draw_text would touch, from the cached layout alone
+static Rect text_bounds(const char *text, int font_size, int x, int y) {
+    const TextLayout *layout = text_layout_get(text, font_size);
+    if (layout->ink.w <= 0) return (Rect){x, y, 0, 0};
+    return (Rect){x + layout->ink.x, y + layout->ink.y, layout->ink.w, layout->ink.h};
+}
+
+void draw_text(uint32_t *buf, const char *text, int font_size, int x, int y, uint32_t color) {
+    if (recording_list) {
+        size_t len = strnlen(text, UINT16_MAX - sizeof(DisplayCmd) - 8);
+        DisplayCmd *cmd = dl_push(DL_TEXT, len + 1, text_bounds(text, font_size, x, y));
+        cmd->x = x;
+        cmd->y = y;
+        cmd->radius = font_size;
+        cmd->color = color;
+        memcpy(cmd + 1, text, len);
+        return;
+    }
+    
+    const TextLayout *layout = tile_worker ? text_layout_peek(text, font_size) : text_layout_get(text, font_size);
+    if (!layout) return;
+    
+    uint32_t source = premultiply(color);
+    int baseline = y + layout->baseline;
+    int clip_x1 = clip_rect.x + clip_rect.w, clip_y1 = clip_rect.y + clip_rect.h;
+    
+    for (int i = 0; i < layout->count; i++) {
+        int codepoint = layout->glyphs[i].codepoint;
+        const Glyph *g = tile_worker ? glyph_cache_peek(codepoint, font_size) : glyph_cache_get(codepoint, font_size);
+        if (!g) break;
+        
+        // Glyphs too large for the atlas are skipped rather than heap-rasterized
+        const unsigned char *bitmap = g->w > 0 && g->h > 0 ? glyph_coverage(g) : NULL;
+        if (!bitmap) continue;
+        
+        // Clip the glyph box once, then blend its coverage row by row
+        int gx = x + layout->glyphs[i].x + g->x0, gy = baseline + g->y0;
+        int col0 = gx < clip_rect.x ? clip_rect.x - gx : 0;
+        int col1 = gx + g->w > clip_x1 ? clip_x1 - gx : g->w;
+        int row0 = gy < clip_rect.y ? clip_rect.y - gy : 0;
+        int row1 = gy + g->h > clip_y1 ? clip_y1 - gy : g->h;
+        for (int row = row0; row < row1 && col1 > col0; row++) {
+            blend_coverage_row(buf + (gy + row) * screen_w + gx + col0, source,
+                               bitmap + row * GLYPH_ATLAS_WIDTH + col0, col1 - col0);
+        }
+    }
+    
+    if (layout->ink.w > 0) {
+        damage_record(buf, x + layout->ink.x, y + layout->ink.y, layout->ink.w, layout->ink.h);
+    }
+}
+
+void draw_text_centered(uint32_t *buf, const char *text, int font_size, int y, uint32_t color) {
+    // Measuring lays the string out; draw_text then hits the same cached layout
+    int text_width = measure_text_width(text, font_size);
+    int x = (screen_w - text_width) / 2;
+    draw_text(buf, text, font_size, x, y, color);
+}
+
+void draw_image(uint32_t *buf, const uint32_t *pixels, int w, int h, int x, int y) {
+    if (w <= 0 || h <= 0) return;
+    if (recording_list) {
+        DisplayCmd *cmd = dl_push(DL_IMAGE, sizeof(DisplayImage), (Rect){x, y, w, h});
+        cmd->x = x;
+        cmd->y = y;
+        cmd->w = w;
+        cmd->h = h;
+        
+        // FNV-1a over the pixels
+        DisplayImage *image = (DisplayImage *)(cmd + 1);
+        image->pixels = pixels;
+        image->hash = 14695981039346656037ULL;
+        for (int i = 0; i < w * h; i++) {
+            image->hash = (image->hash ^ pixels[i]) * 1099511628211ULL;
+        }
+        return;
+    }
+    
+    int dx = x, dy = y, dw = w, dh = h;
+    if (!clip_rect_to_clip(&dx, &dy, &dw, &dh)) return;
+    damage_record(buf, dx, dy, dw, dh);
+    for (int row = dy; row < dy + dh; row++) {
+        pixel_kernels.copy(buf + row * screen_w + dx, pixels + (row - y) * w + (dx - x), dw);
+    }
+}
+
+static void dl_execute_cmd(const DisplayCmd *cmd, uint32_t *buf) {
+    switch (cmd->op) {
+        case DL_CLEAR:
+            clear_screen(buf, cmd->color);
+            break;
+        case DL_RECT:
+            draw_rect(buf, cmd->x, cmd->y, cmd->w, cmd->h, cmd->color);
+            break;
+        case DL_ROUNDED_RECT:
+            draw_rounded_rect_shape(buf, cmd->x, cmd->y, cmd->w, cmd->h, cmd->radius, cmd->color, cmd->antialias);
+            break;
+        case DL_CIRCLE:
+            draw_circle_shape(buf, cmd->x, cmd->y, cmd->w, cmd->color, cmd->antialias);
+            break;
+        case DL_TEXT:
+            draw_text(buf, (const char *)(cmd + 1), cmd->radius, cmd->x, cmd->y, cmd->color);
+            break;
+        case DL_IMAGE:
+            draw_image(buf, ((const DisplayImage *)(cmd + 1))->pixels, cmd->w, cmd->h, cmd->x, cmd->y);
+            break;
+    }
+}
+
+// Replay a list into buf on this thread, skipping commands entirely outside clip_rect
+static void dl_execute_serial(const DisplayList *list, uint32_t *buf) {
+    for (size_t offset = 0; offset < list->used; ) {
+        const DisplayCmd *cmd = (const DisplayCmd *)(list->arena + offset);
+        offset += cmd->size;
+        if (rects_overlap(cmd->bounds, clip_rect)) dl_execute_cmd(cmd, buf);
+    }
+}
+
+// Range of tiles of area that bounds touches, as [tx0, tx1) x [ty0, ty1)
+static int tile_span(Rect bounds, Rect area, int *tx0, int *ty0, int *tx1, int *ty1) {
+    int x0 = bounds.x > area.x ? bounds.x : area.x;
+    int y0 = bounds.y > area.y ? bounds.y : area.y;
+    int x1 = bounds.x + bounds.w < area.x + area.w ? bounds.x + bounds.w : area.x + area.w;
+    int y1 = bounds.y + bounds.h < area.y + area.h ? bounds.y + bounds.h : area.y + area.h;
+    if (x1 <= x0 || y1 <= y0) return 0;
+    
+    *tx0 = (x0 - area.x) / TILE_SIZE;
+    *ty0 = (y0 - area.y) / TILE_SIZE;
+    *tx1 = (x1 - 1 - area.x) / TILE_SIZE + 1;
+    *ty1 = (y1 - 1 - area.y) / TILE_SIZE + 1;
+    return 1;
+}
+
+// Bin the commands touching clip_rect into tiles. The main thread also does the
+// two things tile workers must not: recording damage and filling the glyph and
+// text layout caches. Returns 0 if the list has to be replayed serially instead -
+// when out of memory, or when warming recycled atlas space or layout slots and
+// may have evicted an earlier entry.
+static int tile_bins_build(const DisplayList *list, uint32_t *buf) {
+    TileBins *bins = &tile_bins;
+    Rect area = clip_rect;
+    int tiles_x = (area.w + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (area.h + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles = tiles_x * tiles_y;
+    
+    if (tiles + 1 > bins->bins_capacity) {
+        int *start = realloc(bins->bin_start, (tiles + 1) * sizeof(int));
+        if (start) bins->bin_start = start;
+        int *fill = realloc(bins->bin_fill, (tiles + 1) * sizeof(int));
+        if (fill) bins->bin_fill = fill;
+        if (!start || !fill) return 0;
+        bins->bins_capacity = tiles + 1;
+    }
+    memset(bins->bin_start, 0, (tiles + 1) * sizeof(int));
+    uint64_t recycled = glyph_cache.shelf_evictions + glyph_cache.flushes + text_layouts.evictions;
+    
+    // Count pass: bin_start[t + 1] collects tile t's command count
+    int tx0, ty0, tx1, ty1;
+    for (size_t offset = 0; offset < list->used; ) {
+        const DisplayCmd *cmd = (const DisplayCmd *)(list->arena + offset);
+        offset += cmd->size;
+        if (!tile_span(cmd->bounds, area, &tx0, &ty0, &tx1, &ty1)) continue;
+        
+        for (int ty = ty0; ty < ty1; ty++) {
+            for (int tx = tx0; tx < tx1; tx++) bins->bin_start[ty * tiles_x + tx + 1]++;
+        }
+        damage_record(buf, cmd->bounds.x, cmd->bounds.y, cmd->bounds.w, cmd->bounds.h);
+        if (cmd->op == DL_TEXT) {
+            const TextLayout *layout = text_layout_get((const char *)(cmd + 1), cmd->radius);
+            for (int i = 0; i < layout->count; i++) glyph_cache_get(layout->glyphs[i].codepoint, cmd->radius);
+        }
+    }
+    if (glyph_cache.shelf_evictions + glyph_cache.flushes + text_layouts.evictions != recycled) return 0;
+    
+    for (int t = 0; t < tiles; t++) bins->bin_start[t + 1] += bins->bin_start[t];
+    int total = bins->bin_start[tiles];
+    if (total > bins->cmds_capacity) {
+        uint32_t *cmds = realloc(bins->cmds, total * sizeof(uint32_t));
+        if (!cmds) return 0;
+        bins->cmds = cmds;
+        bins->cmds_capacity = total;
+    }
+    
+    // Fill pass, in list order so every tile keeps the recorded paint order
+    memcpy(bins->bin_fill, bins->bin_start, tiles * sizeof(int));
+    for (size_t offset = 0; offset < list->used; ) {
+        const DisplayCmd *cmd = (const DisplayCmd *)(list->arena + offset);
+        uint32_t cmd_offset = offset;
+        offset += cmd->size;
+        if (!tile_span(cmd->bounds, area, &tx0, &ty0, &tx1, &ty1)) continue;
+        
+        for (int ty = ty0; ty < ty1; ty++) {
+            for (int tx = tx0; tx < tx1; tx++) bins->cmds[bins->bin_fill[ty * tiles_x + tx]++] = cmd_offset;
+        }
+    }
+    
+    bins->list = list;
+    bins->buf = buf;
+    bins->area = area;
+    bins->tiles_x = tiles_x;
+    bins->tiles_y = tiles_y;
+    return tiles;
+}
+
+static void tile_replay(void *ctx, int start, int end) {
+    TileBins *bins = ctx;
+    Rect saved_clip = clip_rect;
+    int area_x1 = bins->area.x + bins->area.w, area_y1 = bins->area.y + bins->area.h;
+    tile_worker = 1;
+    
+    for (int t = start; t < end; t++) {
+        int x = bins->area.x + t % bins->tiles_x * TILE_SIZE;
+        int y = bins->area.y + t / bins->tiles_x * TILE_SIZE;
+        clip_rect = (Rect){x, y, x + TILE_SIZE < area_x1 ? TILE_SIZE : area_x1 - x,
+                           y + TILE_SIZE < area_y1 ? TILE_SIZE : area_y1 - y};
+        for (int i = bins->bin_start[t]; i < bins->bin_start[t + 1]; i++) {
+            dl_execute_cmd((const DisplayCmd *)(bins->list->arena + bins->cmds[i]), bins->buf);
+        }
+    }
+    
+    tile_worker = 0;
+    clip_rect = saved_clip;
+}
+
+// Replay a list into buf, clipped to clip_rect. Large areas are split into
+// tiles that render threads claim as they go. Every pixel still sees the same
+// commands in the same order, so the output matches a serial replay exactly.
+void dl_execute(const DisplayList *list, uint32_t *buf) {
+    int tiles = ((clip_rect.w + TILE_SIZE - 1) / TILE_SIZE) * ((clip_rect.h + TILE_SIZE - 1) / TILE_SIZE);
+    if (render_pool.active > 1 && tiles >= TILE_MIN_COUNT && tile_bins_build(list, buf)) {
+        parallel_range(tile_replay, &tile_bins, tiles);
+    } else {
+        dl_execute_serial(list, buf);
+    }
+}
+
+int dl_equal(const DisplayList *a, const DisplayList *b) {
+    return a->valid && b->valid && a->used == b->used && memcmp(a->arena, b->arena, a->used) == 0;
+}
+
+// Damage the bounds of every command that differs between the lists, matched by
+// position. A pixel outside all of them is covered by the same sequence of
+// commands in both lists, so it cannot have changed. Returns the number of
+// differing commands.
+int dl_diff(const DisplayList *old, const DisplayList *new, DamageList *damage) {
+    if (!old->valid) {
+        damage_add(damage, 0, 0, screen_w, screen_h);
+        return new->count;
+    }
+    if (dl_equal(old, new)) return 0;
+    
+    int changed = 0;
+    size_t a = 0, b = 0;
+    while (a < old->used || b < new->used) {
+        const DisplayCmd *ca = a < old->used ? (const DisplayCmd *)(old->arena + a) : NULL;
+        const DisplayCmd *cb = b < new->used ? (const DisplayCmd *)(new->arena + b) : NULL;
+        if (ca) a += ca->size;
+        if (cb) b += cb->size;
+        if (ca && cb && ca->size == cb->size && memcmp(ca, cb, ca->size) == 0) continue;
+        
+        if (ca) damage_add(damage, ca->bounds.x, ca->bounds.y, ca->bounds.w, ca->bounds.h);
+        if (cb) damage_add(damage, cb->bounds.x, cb->bounds.y, cb->bounds.w, cb->bounds.h);
+        changed++;
+    }
+    return changed;
+}
+
+time_t shell_time(void) {
+    return fixed_clock ? fixed_clock : time(NULL);
+}
+
+void get_current_time(char *time_str, char *date_str) {
+    time_t now = shell_time();
+    struct tm *tm = localtime(&now);
+    if (time_str) strftime(time_str, 32, "%H:%M", tm);
+    if (date_str) strftime(date_str, 64, "%A, %B %d", tm);
+}
+
+void draw_status_bar(uint32_t *buf) {
+    char time_str[32];
+    get_current_time(time_str, NULL);
+    draw_text_centered(buf, time_str, MEDIUM_TEXT, 25, COLOR_WHITE);
+    
+    // Battery indicator
+    int bat_x = screen_w - 200, bat_y = 25;
+    int bat_w = 80, bat_h = 40;
+    
+    draw_rounded_rect(buf, bat_x, bat_y, bat_w, bat_h, 8, COLOR_WHITE);
+    draw_rounded_rect(buf, bat_x + 3, bat_y + 3, bat_w - 6, bat_h - 6, 5, COLOR_BG);
+    draw_rounded_rect(buf, bat_x + bat_w, bat_y + 12, 8, 16, 4, COLOR_WHITE);
+    
+    int fill_width = (int)((bat_w - 6) * battery_level / 100.0f);
+    uint32_t fill_color = battery_level > 20 ? COLOR_GREEN : COLOR_RED;
+    if (fill_width > 0) {
+        draw_rounded_rect(buf, bat_x + 3, bat_y + 3, fill_width, bat_h - 6, 5, fill_color);
+    }
+    
+    char bat_text[8];
+    snprintf(bat_text, sizeof(bat_text), "%d%%", battery_level);
+    draw_text(buf, bat_text, SMALL_TEXT, bat_x - 100, bat_y + 5, COLOR_WHITE);
+    
+    // Cellular bars
+    int bars_bottom = 65;
+    for (int i = 0; i < 4; i++) {
+        int bar_h = 12 + i * 8;
+        int bar_y = bars_bottom - bar_h;
+        draw_rect(buf, 80 + i * 20, bar_y, 12, bar_h, COLOR_WHITE);
+    }
+}
+
+int is_touching_home_indicator(int touch_x, int touch_y) {
+    int bar_center_x = screen_w / 2;
+    int bar_y_start = screen_h - 80;  // Where the bar starts
+    int bar_width = 200;
+    int bar_extended_width = 280;  // Extended hitbox
+    
+    // Check if touch is within the horizontal bounds
+    int x_in_range = (touch_x >= (bar_center_x - bar_extended_width/2)) && 
+                     (touch_x <= (bar_center_x + bar_extended_width/2));
+    
+    // Check if touch is from the bar position down to bottom edge
+    int y_in_range = (touch_y >= bar_y_start);
+    
+    return x_in_range && y_in_range;
+}
+
+static int compare_app_names(const void *a, const void *b) {
+    return strcmp(((const App *)a)->name, ((const App *)b)->name);
+}
+
+// Every NAME.so in DIR becomes an app called NAME. Nothing is loaded here, so
+// startup stays flat however many apps are installed.
+void discover_apps(const char *dir) {
+    static const uint32_t palette[] = {COLOR_GREEN, COLOR_BLUE, COLOR_ORANGE, COLOR_PURPLE, COLOR_RED};
+    DIR *d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "⚠️ No app directory %s\n", dir);
+        return;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL && num_apps < MAX_APPS) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 3 || strcmp(entry->d_name + len - 3, ".so") != 0 || len - 3 >= sizeof(apps[0].name)) continue;
+        
+        App *app = &apps[num_apps++];
+        memset(app, 0, sizeof(*app));
+        memcpy(app->name, entry->d_name, len - 3);
+        snprintf(app->path, sizeof(app->path), "%s/%s", dir, entry->d_name);
+    }
+    closedir(d);
+    
+    qsort(apps, num_apps, sizeof(App), compare_app_names);
+    for (int i = 0; i < num_apps; i++) {
+        apps[i].id = i;
+        apps[i].color = palette[i % (sizeof(palette) / sizeof(palette[0]))];
+    }
+    printf("📦 %d app(s) in %s\n", num_apps, dir);
+}
+
+// dlopen an app's module if it isn't loaded yet. Returns 0 if it can't be used.
+static int app_load(int app_id) {
+    App *app = &apps[app_id];
+    app->unload_pending = 0;
+    if (app->module) return 1;
+    
+    void *handle = dlopen(app->path, RTLD_NOW | RTLD_LOCAL);
+    const AppModule *module = handle ? dlsym(handle, APP_MODULE_SYMBOL) : NULL;
+    if (!module) {
+        fprintf(stderr, "⚠️ %s: %s\n", app->path, dlerror());
+    } else if (module->abi_version != APP_MODULE_ABI_VERSION || !module->draw) {
+        fprintf(stderr, "⚠️ %s: module ABI %u, shell expects %d\n", app->path, module->abi_version, APP_MODULE_ABI_VERSION);
+        module = NULL;
+    }
+    if (!module) {
+        if (handle) dlclose(handle);
+        return 0;
+    }
+    
+    app->handle = handle;
+    app->module = module;
+    printf("📦 Loaded %s\n", app->path);
+    return 1;
+}
+
+static void app_unload(int app_id) {
+    App *app = &apps[app_id];
+    if (!app->handle) return;
+    dlclose(app->handle);
+    app->handle = NULL;
+    app->module = NULL;
+    app->unload_pending = 0;
+    printf("📦 Unloaded %s\n", app->path);
+}
+
+// A closed app's module stays mapped until the last of its jobs has run done()
+static void app_job_finished(int app_id) {
+    if (--apps[app_id].jobs == 0 && apps[app_id].unload_pending) app_unload(app_id);
+}
+
+// Module entry points run with calling_app set, so jobs they submit are
+// attributed to the app and keep its module loaded
+static void app_suspend(void) {
+    if (foreground_app < 0) return;
+    App *app = &apps[foreground_app];
+    if (app->module && app->module->suspend) {
+        calling_app = foreground_app;
+        app->module->suspend();
+        calling_app = -1;
+    }
+    foreground_app = -1;
+}
+
+static void app_resume(int app_id) {
+    if (foreground_app == app_id) return;
+    app_suspend();
+    App *app = &apps[app_id];
+    if (app->module && app->module->resume) {
+        calling_app = app_id;
+        app->module->resume();
+        calling_app = -1;
+    }
+    foreground_app = app_id;
+}
+
+void add_open_app(int app_id) {
+    if (app_id >= 0 && app_id < num_apps && !open_apps[app_id]) {
+        open_apps[app_id] = 1;
+        num_open_apps++;
+        printf("📱 Opened app: %s (total open: %d)\n", apps[app_id].name, num_open_apps);
+    }
+}
+
+void remove_open_app(int app_id) {
+    if (app_id >= 0 && app_id < num_apps && open_apps[app_id]) {
+        open_apps[app_id] = 0;
+        app_snapshots[app_id].valid = 0;
+        num_open_apps--;
+        printf("❌ Closed app: %s (total open: %d)\n", apps[app_id].name, num_open_apps);
+        
+        if (foreground_app == app_id) app_suspend();
+        surface_release(app_id);
+        if (apps[app_id].jobs > 0) {
+            apps[app_id].unload_pending = 1;
+        } else {
+            app_unload(app_id);
+        }
+    }
+}
+
+// Load, open and show an app. Returns 0 if its module can't be loaded.
+static int show_app(int app_id) {
+    if (!app_load(app_id)) return 0;
+    add_open_app(app_id);
+    current_app = app_id;
+    current_state = APP_SCREEN;
+    animation_target_state = APP_SCREEN;
+    app_resume(app_id);
+    return 1;
+}
+
+AppState get_home_gesture_target(AppState current) {
+    switch (current) {
+        case APP_SCREEN:
+            return HOME_SCREEN;
+        case HOME_SCREEN:
+            return (num_open_apps > 0) ? APP_SWITCHER : HOME_SCREEN;
+        case APP_SWITCHER:
+            return HOME_SCREEN;
+        default:
+            return current;
+    }
+}
+
+float calculate_scale_from_drag(int drag_distance) {
+    if (drag_distance < 20) return 1.0f;
+    
+    // Linear scaling that goes from 1.0 to a minimum scale
+    float max_drag = screen_h - 120; // Full screen drag distance
+    float min_scale = 0.15f; // Small enough to leave margin at top when finger is at top
+    
+    float normalized = (drag_distance - 20) / max_drag;
     if (normalized > 1.0f) normalized = 1.0f;
     
-    float scale = 1.0f - normalized * (1.0f - min_scale);
+    float scale = 1.0f - normalized * (1.0f - min_scale);
+    
+    return scale;
+}
+
+// A release still moving up fast counts as a swipe, however short the drag was
+int is_flick_up(int start_x, int start_y, int end_x, int end_y, float vx, float vy) {
+    int dx = end_x - start_x;
+    int dy = start_y - end_y;
+    
+    return (dy > SWIPE_THRESHOLD &&
+            dy > abs(dx) &&
+            -vy > FLICK_VELOCITY &&
+            -vy > fabsf(vx));
+}
+
+static void render_pool_run_chunks(void) {
+    for (;;) {
+        int start = __atomic_fetch_add(&render_pool.next, render_pool.chunk, __ATOMIC_RELAXED);
+        if (start >= render_pool.count) break;
+        int end = start + render_pool.chunk;
+        if (end > render_pool.count) end = render_pool.count;
+        render_pool.task(render_pool.ctx, start, end);
+    }
+}
+
+static void *render_worker(void *arg) {
+    int index = (int)(intptr_t)arg;
+    uint64_t seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&render_pool.lock);
+        while (render_pool.generation == seen) {
+            pthread_cond_wait(&render_pool.work_ready, &render_pool.lock);
+        }
+        seen = render_pool.generation;
+        int participate = index < render_pool.participants;
+        pthread_mutex_unlock(&render_pool.lock);
+        if (!participate) continue;
+        
+        render_pool_run_chunks();
+        
+        pthread_mutex_lock(&render_pool.lock);
+        if (--render_pool.busy_workers == 0) pthread_cond_signal(&render_pool.work_done);
+        pthread_mutex_unlock(&render_pool.lock);
+    }
+    return NULL;
+}
+
+void init_render_pool(int num_threads) {
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > MAX_RENDER_THREADS) num_threads = MAX_RENDER_THREADS;
+    
+    pthread_mutex_init(&render_pool.lock, NULL);
+    pthread_cond_init(&render_pool.work_ready, NULL);
+    pthread_cond_init(&render_pool.work_done, NULL);
+    render_pool.num_threads = 1;
+    
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&render_pool.threads[i], NULL, render_worker, (void *)(intptr_t)i) != 0) {
+            perror("Render thread creation failed");
+            break;
+        }
+        render_pool.num_threads++;
+    }
+    render_pool.active = render_pool.num_threads;
+    printf("🧵 Render threads: %d\n", render_pool.num_threads);
+}
+
+// Spread later work over only the first n threads; the rest stay parked.
+// Must not be called while a parallel_range is running.
+void render_pool_set_active(int n) {
+    if (n < 1) n = 1;
+    if (n > render_pool.num_threads) n = render_pool.num_threads;
+    render_pool.active = n;
+}
+
+// Run task over [0, count) in chunks on every render thread, returning when all are done
+void parallel_range(RangeTask task, void *ctx, int count) {
+    if (count <= 0) return;
+    int chunk = count / (render_pool.active * 4);
+    if (chunk < 1) chunk = 1;
+    
+    if (render_pool.active == 1 || count == chunk) {
+        task(ctx, 0, count);
+        return;
+    }
+    
+    pthread_mutex_lock(&render_pool.lock);
+    render_pool.task = task;
+    render_pool.ctx = ctx;
+    render_pool.count = count;
+    render_pool.chunk = chunk;
+    render_pool.next = 0;
+    render_pool.participants = render_pool.active;
+    render_pool.busy_workers = render_pool.active - 1;
+    render_pool.generation++;
+    pthread_cond_broadcast(&render_pool.work_ready);
+    pthread_mutex_unlock(&render_pool.lock);
+    
+    render_pool_run_chunks();
+    
+    pthread_mutex_lock(&render_pool.lock);
+    while (render_pool.busy_workers > 0) {
+        pthread_cond_wait(&render_pool.work_done, &render_pool.lock);
+    }
+    pthread_mutex_unlock(&render_pool.lock);
+}
+
+static void *job_worker(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&job_pool.lock);
+        while (job_pool.pending_count == 0) {
+            pthread_cond_wait(&job_pool.work_ready, &job_pool.lock);
+        }
+        Job job = job_pool.pending[job_pool.pending_head];
+        job_pool.pending_head = (job_pool.pending_head + 1) % MAX_JOBS;
+        job_pool.pending_count--;
+        pthread_mutex_unlock(&job_pool.lock);
+        
+        if (job.work) job.work(job.data);
+        
+        pthread_mutex_lock(&job_pool.lock);
+        job_pool.done[(job_pool.done_head + job_pool.done_count) % MAX_JOBS] = job;
+        job_pool.done_count++;
+        pthread_mutex_unlock(&job_pool.lock);
+        wake_main_loop();
+    }
+    return NULL;
+}
+
+void init_job_pool(void) {
+    pthread_mutex_init(&job_pool.lock, NULL);
+    pthread_cond_init(&job_pool.work_ready, NULL);
+    
+    for (int i = 0; i < MAX_JOB_THREADS; i++) {
+        if (pthread_create(&job_pool.threads[i], NULL, job_worker, NULL) != 0) {
+            perror("Job thread creation failed");
+            exit(1);
+        }
+    }
+}
+
+// Queue work for a job thread. Returns 0 if too many jobs are already outstanding.
+int submit_job(JobWork work, JobDone done, void *data, int x, int y, int w, int h) {
+    pthread_mutex_lock(&job_pool.lock);
+    if (job_pool.outstanding == MAX_JOBS) {
+        pthread_mutex_unlock(&job_pool.lock);
+        return 0;
+    }
+    job_pool.pending[(job_pool.pending_head + job_pool.pending_count) % MAX_JOBS] =
+        (Job){work, done, data, {x, y, w, h}, calling_app};
+    job_pool.pending_count++;
+    job_pool.outstanding++;
+    pthread_cond_signal(&job_pool.work_ready);
+    pthread_mutex_unlock(&job_pool.lock);
+    if (calling_app >= 0) apps[calling_app].jobs++;
+    return 1;
+}
+
+// Run completion callbacks for finished jobs on the UI thread and mark their regions dirty.
+// Returns the number of jobs completed.
+int run_completed_jobs(void) {
+    int completed = 0;
+    for (;;) {
+        pthread_mutex_lock(&job_pool.lock);
+        if (job_pool.done_count == 0) {
+            pthread_mutex_unlock(&job_pool.lock);
+            break;
+        }
+        Job job = job_pool.done[job_pool.done_head];
+        job_pool.done_head = (job_pool.done_head + 1) % MAX_JOBS;
+        job_pool.done_count--;
+        job_pool.outstanding--;
+        pthread_mutex_unlock(&job_pool.lock);
+        
+        calling_app = job.owner;
+        if (job.done) job.done(job.data);
+        calling_app = -1;
+        if (job.dirty.w > 0 && job.dirty.h > 0) {
+            invalidate_rect(job.dirty.x, job.dirty.y, job.dirty.w, job.dirty.h);
+        }
+        if (job.owner >= 0) app_job_finished(job.owner);
+        completed++;
+    }
+    return completed;
+}
+
+void init_blur_cache(void) {
+    blur_cache.w = (screen_w + BLUR_DOWNSAMPLE - 1) / BLUR_DOWNSAMPLE;
+    blur_cache.h = (screen_h + BLUR_DOWNSAMPLE - 1) / BLUR_DOWNSAMPLE;
+    size_t small_bytes = (size_t)blur_cache.w * blur_cache.h * 4;
+    
+    blur_cache.source = malloc(small_bytes);
+    blur_cache.scratch = malloc(small_bytes);
+    blur_cache.wide = malloc((size_t)screen_w * blur_cache.h * 4);
+    blur_cache.upsampled = malloc((size_t)screen_w * screen_h * 4);
+    blur_cache.col_index = malloc(screen_w * sizeof(int));
+    blur_cache.col_weight = malloc(screen_w * sizeof(int));
+    if (!blur_cache.source || !blur_cache.scratch || !blur_cache.wide || !blur_cache.upsampled ||
+        !blur_cache.col_index || !blur_cache.col_weight) {
+        perror("Blur cache allocation failed");
+        exit(1);
+    }
+    for (int i = 1; i < BLUR_LEVELS; i++) {
+        blur_cache.levels[i] = malloc(small_bytes);
+        if (!blur_cache.levels[i]) { perror("Blur cache allocation failed"); exit(1); }
+    }
+    
+    // Bilinear source column and 8-bit weight for every full-resolution column
+    for (int x = 0; x < screen_w; x++) {
+        int fx = (int)(((x + 0.5f) / BLUR_DOWNSAMPLE - 0.5f) * 256.0f);
+        if (fx < 0) fx = 0;
+        int ix = fx >> 8;
+        if (ix >= blur_cache.w - 1) { ix = blur_cache.w - 1; fx = ix << 8; }
+        blur_cache.col_index[x] = ix;
+        blur_cache.col_weight[x] = fx & 0xFF;
+    }
+    
+    blur_cache_invalidate();
+}
+
+// Home screen content changed: every cached level has to be rebuilt
+void blur_cache_invalidate(void) {
+    blur_cache.source_valid = 0;
+    blur_cache.upsampled_level = -1;
+    for (int i = 0; i < BLUR_LEVELS; i++) {
+        blur_cache.level_valid[i] = 0;
+    }
+}
+
+// Average BLUR_DOWNSAMPLE x BLUR_DOWNSAMPLE blocks of the full-res home screen
+static void blur_downsample_rows(void *ctx, int start, int end) {
+    const uint32_t *full = ctx;
+    for (int y = start; y < end; y++) {
+        for (int x = 0; x < blur_cache.w; x++) {
+            uint32_t r = 0, g = 0, b = 0, n = 0;
+            for (int sy = y * BLUR_DOWNSAMPLE; sy < (y + 1) * BLUR_DOWNSAMPLE && sy < screen_h; sy++) {
+                for (int sx = x * BLUR_DOWNSAMPLE; sx < (x + 1) * BLUR_DOWNSAMPLE && sx < screen_w; sx++) {
+                    uint32_t p = full[sy * screen_w + sx];
+                    r += (p >> 16) & 0xFF;
+                    g += (p >> 8) & 0xFF;
+                    b += p & 0xFF;
+                    n++;
+                }
+            }
+            blur_cache.source[y * blur_cache.w + x] = 0xFF000000 | ((r / n) << 16) | ((g / n) << 8) | (b / n);
+        }
+    }
+}
+
+typedef struct {
+    const uint32_t *src;
+    uint32_t *dst;
+    int radius;
+} BoxBlurPass;
+
+// Running-sum box filter over n pixels spaced step apart, clamping at the edges.
+// The divide is a rounded fixed-point multiply, so a flat area keeps its value.
+static void box_blur_line(const uint32_t *src, uint32_t *dst, int n, int step, int radius) {
+    uint32_t mul = ((1 << 16) + radius) / (2 * radius + 1);
+    uint32_t r = 0, g = 0, b = 0;
+    for (int k = -radius; k <= radius; k++) {
+        uint32_t p = src[(k < 0 ? 0 : k >= n ? n - 1 : k) * step];
+        r += (p >> 16) & 0xFF;
+        g += (p >> 8) & 0xFF;
+        b += p & 0xFF;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        dst[i * step] = 0xFF000000 | (((r * mul + (1 << 15)) >> 16) << 16) |
+                        (((g * mul + (1 << 15)) >> 16) << 8) | ((b * mul + (1 << 15)) >> 16);
+        
+        int add = i + radius + 1, sub = i - radius;
+        uint32_t pa = src[(add >= n ? n - 1 : add) * step];
+        uint32_t ps = src[(sub < 0 ? 0 : sub) * step];
+        r += ((pa >> 16) & 0xFF) - ((ps >> 16) & 0xFF);
+        g += ((pa >> 8) & 0xFF) - ((ps >> 8) & 0xFF);
+        b += (pa & 0xFF) - (ps & 0xFF);
+    }
+}
+
+static void box_blur_rows(void *ctx, int start, int end) {
+    BoxBlurPass *pass = ctx;
+    for (int y = start; y < end; y++) {
+        box_blur_line(pass->src + y * blur_cache.w, pass->dst + y * blur_cache.w, blur_cache.w, 1, pass->radius);
+    }
+}
+
+static void box_blur_columns(void *ctx, int start, int end) {
+    BoxBlurPass *pass = ctx;
+    for (int x = start; x < end; x++) {
+        box_blur_line(pass->src + x, pass->dst + x, blur_cache.h, blur_cache.w, pass->radius);
+    }
+}
+
+static void blur_build_level(int level) {
+    uint32_t *out = blur_cache.levels[level];
+    int radius = level * BLUR_MAX_RADIUS / (BLUR_LEVELS - 1);
+    if (radius < 1) radius = 1;
+    
+    // Three box passes approximate a Gaussian
+    const uint32_t *in = blur_cache.source;
+    for (int pass = 0; pass < BLUR_PASSES; pass++) {
+        BoxBlurPass h = {in, blur_cache.scratch, radius};
+        parallel_range(box_blur_rows, &h, blur_cache.h);
+        BoxBlurPass v = {blur_cache.scratch, out, radius};
+        parallel_range(box_blur_columns, &v, blur_cache.w);
+        in = out;
+    }
+    
+    int darken = level * BLUR_MAX_DARKEN / (BLUR_LEVELS - 1);
+    pixel_kernels.darken(out, darken, blur_cache.w * blur_cache.h);
+    blur_cache.level_valid[level] = 1;
+}
+
+static inline uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t w) {
+    uint32_t rb = ((a & 0xFF00FF) * (256 - w) + (b & 0xFF00FF) * w) >> 8;
+    uint32_t g = ((a & 0x00FF00) * (256 - w) + (b & 0x00FF00) * w) >> 8;
+    return 0xFF000000 | (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+// Bilinear upsample is done separably: low-res rows are first stretched to full
+// width, then each output row is one lerp between two stretched rows
+static void blur_widen_rows(void *ctx, int start, int end) {
+    const uint32_t *small = ctx;
+    for (int y = start; y < end; y++) {
+        const uint32_t *row = small + y * blur_cache.w;
+        uint32_t *dst = blur_cache.wide + y * screen_w;
+        for (int x = 0; x < screen_w; x++) {
+            int ix = blur_cache.col_index[x];
+            int ix1 = ix + 1 < blur_cache.w ? ix + 1 : ix;
+            dst[x] = lerp_pixel(row[ix], row[ix1], blur_cache.col_weight[x]);
+        }
+    }
+}
+
+static void blur_upsample_rows(void *ctx, int start, int end) {
+    for (int y = start; y < end; y++) {
+        int fy = (int)(((y + 0.5f) / BLUR_DOWNSAMPLE - 0.5f) * 256.0f);
+        if (fy < 0) fy = 0;
+        int iy = fy >> 8, wy = fy & 0xFF;
+        if (iy >= blur_cache.h - 1) { iy = blur_cache.h - 1; wy = 0; }
+        
+        const uint32_t *row0 = blur_cache.wide + iy * screen_w;
+        uint32_t *dst = blur_cache.upsampled + y * screen_w;
+        if (wy == 0) {
+            memcpy(dst, row0, screen_w * 4);
+            continue;
+        }
+        const uint32_t *row1 = row0 + screen_w;
+        for (int x = 0; x < screen_w; x++) {
+            dst[x] = lerp_pixel(row0[x], row1[x], wy);
+        }
+    }
+}
+
+// Record the home screen for gesture frames. The cached blur levels stay valid
+// for as long as it records the same.
+const DisplayList *record_home_screen(void) {
+    DisplayList *home = &blur_cache.home_lists[blur_cache.home_list ^ 1];
+    record_screen(home, HOME_SCREEN);
+    if (!dl_equal(&blur_cache.home_lists[blur_cache.home_list], home)) {
+        blur_cache_invalidate();
+        blur_cache.home_list ^= 1;
+    }
+    return &blur_cache.home_lists[blur_cache.home_list];
+}
+
+// Frosted home screen behind the switcher transition. The home screen doesn't change
+// during a gesture, so each blur level is computed once at low resolution and the
+// most recent level is kept upsampled; steady frames are a plain copy.
+void draw_blurred_home(uint32_t *buf, float blur_amount) {
+    int level = (int)(blur_amount / 0.5f * (BLUR_LEVELS - 1) + 0.5f);
+    if (level >= BLUR_LEVELS) level = BLUR_LEVELS - 1;
+    const DisplayList *home = record_home_screen();
+    if (blur_amount < 0.1f || level < 1) {
+        dl_execute(home, buf);
+        return;
+    }
+    
+    uint64_t perf_start = perf_begin();
+    
+    if (!blur_cache.source_valid) {
+        // Render home at full resolution into the upsample buffer, then shrink it
+        Rect saved_clip = clip_rect;
+        clip_rect = (Rect){0, 0, screen_w, screen_h};
+        dl_execute(home, blur_cache.upsampled);
+        clip_rect = saved_clip;
+        
+        parallel_range(blur_downsample_rows, blur_cache.upsampled, blur_cache.h);
+        blur_cache.source_valid = 1;
+        blur_cache.upsampled_level = -1;
+    }
+    
+    if (!blur_cache.level_valid[level]) blur_build_level(level);
+    
+    if (blur_cache.upsampled_level != level) {
+        parallel_range(blur_widen_rows, blur_cache.levels[level], blur_cache.h);
+        parallel_range(blur_upsample_rows, NULL, screen_h);
+        blur_cache.upsampled_level = level;
+    }
+    
+    damage_record(buf, clip_rect.x, clip_rect.y, clip_rect.w, clip_rect.h);
+    for (int y = clip_rect.y; y < clip_rect.y + clip_rect.h; y++) {
+        pixel_kernels.copy(buf + y * screen_w + clip_rect.x, blur_cache.upsampled + y * screen_w + clip_rect.x, clip_rect.w);
+    }
+    perf_end(PERF_BLUR, perf_start);
+}
+
+void init_window_scaler(void) {
+    window_scaler.x_index = malloc(screen_w * sizeof(int));
+    window_scaler.x_weight = malloc(screen_w * sizeof(int));
+    window_scaler.y_index = malloc(screen_h * sizeof(int));
+    window_scaler.y_weight = malloc(screen_h * sizeof(int));
+    if (!window_scaler.x_index || !window_scaler.x_weight || !window_scaler.y_index || !window_scaler.y_weight) {
+        perror("Scaler table allocation failed");
+        exit(1);
+    }
+    
+    for (int level = 1; level < SCALE_MIP_LEVELS; level++) {
+        window_scaler.mips[level] = malloc((size_t)(screen_w >> level) * (screen_h >> level) * 4);
+        if (!window_scaler.mips[level]) { perror("Scaler mip allocation failed"); exit(1); }
+    }
+    window_scaler.dst_w = -1;
+}
+
+// The window source's pixels changed, so its mip levels must be rebuilt
+void window_scaler_source_changed(void) {
+    window_scaler.mips_built = 0;
+}
+
+// Map dst_size destination samples onto src_size source samples, pixel centers aligned.
+// Indices are clamped so index + 1 is always a valid bilinear neighbour.
+static void scaler_build_axis(int *index, int *weight, int dst_size, int src_size, ScaleFilter filter) {
+    int64_t step = ((int64_t)src_size << 16) / dst_size;
+    for (int i = 0; i < dst_size; i++) {
+        int64_t pos = (int64_t)i * step + step / 2;        // Source position of the center, 16.16
+        if (filter == SCALE_NEAREST) {
+            int idx = (int)(pos >> 16);
+            index[i] = idx < src_size ? idx : src_size - 1;
+            weight[i] = 0;
+            continue;
+        }
+        
+        pos -= 1 << 15;
+        if (pos < 0) pos = 0;
+        int idx = (int)(pos >> 16);
+        int w = (int)((pos >> 8) & 0xFF);
+        if (idx >= src_size - 1) { idx = src_size > 1 ? src_size - 2 : 0; w = src_size > 1 ? 256 : 0; }
+        index[i] = idx;
+        weight[i] = w;
+    }
+}
+
+// Halve a mip level with a 2x2 box filter
+static void scaler_build_mip_rows(void *ctx, int start, int end) {
+    int level = (int)(intptr_t)ctx;
+    const uint32_t *src = window_scaler.mips[level - 1];
+    int src_w = screen_w >> (level - 1), dst_w = screen_w >> level;
+    uint32_t *dst = window_scaler.mips[level];
+    
+    for (int y = start; y < end; y++) {
+        const uint32_t *r0 = src + (y * 2) * src_w, *r1 = r0 + src_w;
+        for (int x = 0; x < dst_w; x++) {
+            uint32_t a = r0[x * 2], b = r0[x * 2 + 1], c = r1[x * 2], d = r1[x * 2 + 1];
+            uint32_t rb = ((a & 0xFF00FF) + (b & 0xFF00FF) + (c & 0xFF00FF) + (d & 0xFF00FF) + 0x020002) >> 2;
+            uint32_t g = ((a & 0x00FF00) + (b & 0x00FF00) + (c & 0x00FF00) + (d & 0x00FF00) + 0x000200) >> 2;
+            dst[y * dst_w + x] = 0xFF000000 | (rb & 0xFF00FF) | (g & 0x00FF00);
+        }
+    }
+}
+
+static void scale_rows_nearest(void *ctx, int start, int end) {
+    ScaleJob *job = ctx;
+    for (int y = job->y0 + start; y < job->y0 + end; y++) {
+        const uint32_t *src_row = job->src + window_scaler.y_index[y - job->start_y] * job->src_w;
+        uint32_t *dst_row = job->dest + y * screen_w;
+        const int *xi = window_scaler.x_index - job->start_x;
+        for (int x = job->x0; x < job->x1; x++) {
+            dst_row[x] = src_row[xi[x]];
+        }
+    }
+}
+
+static void scale_rows_bilinear(void *ctx, int start, int end) {
+    ScaleJob *job = ctx;
+    for (int y = job->y0 + start; y < job->y0 + end; y++) {
+        int sy = y - job->start_y;
+        const uint32_t *r0 = job->src + window_scaler.y_index[sy] * job->src_w;
+        const uint32_t *r1 = job->src_h > 1 ? r0 + job->src_w : r0;
+        int wy = window_scaler.y_weight[sy];
+        uint32_t *dst_row = job->dest + y * screen_w;
+        const int *xi = window_scaler.x_index - job->start_x;
+        const int *xw = window_scaler.x_weight - job->start_x;
+        
+        for (int x = job->x0; x < job->x1; x++) {
+            int ix = xi[x], wx = xw[x];
+            uint32_t top = lerp_pixel(r0[ix], r0[ix + 1], wx);
+            uint32_t bottom = lerp_pixel(r1[ix], r1[ix + 1], wx);
+            dst_row[x] = lerp_pixel(top, bottom, wy);
+        }
+    }
+}
+
+void draw_scaled_window(uint32_t *dest, uint32_t *src, float scale, int finger_x, int finger_y) {
+    int scaled_w = (int)(screen_w * scale);
+    int scaled_h = (int)(screen_h * scale);
+    if (scaled_w <= 0 || scaled_h <= 0) return;
+    
+    // Position window so its bottom center is at the finger position
+    int center_x = finger_x;
+    int bottom_y = finger_y;
+    
+    // Keep window on screen horizontally
+    if (center_x - scaled_w/2 < 0) center_x = scaled_w/2;
+    if (center_x + scaled_w/2 > screen_w) center_x = screen_w - scaled_w/2;
+    
+    // Keep window on screen vertically (bottom anchored)
+    if (bottom_y - scaled_h < 0) bottom_y = scaled_h;
+    if (bottom_y > screen_h) bottom_y = screen_h;
+    
+    int start_x = center_x - scaled_w/2;
+    int start_y = bottom_y - scaled_h;
+    damage_record(dest, start_x, start_y, scaled_w, scaled_h);
+    
+    // Clip the destination once; the row loops below never test bounds
+    int x0 = start_x, y0 = start_y, w = scaled_w, h = scaled_h;
+    if (!clip_rect_to_clip(&x0, &y0, &w, &h)) return;
+    uint64_t perf_start = perf_begin();
+    
+    // At 1:1 a row is a straight copy of the clipped span
+    if (scaled_w == screen_w && scaled_h == screen_h) {
+        for (int y = y0; y < y0 + h; y++) {
+            pixel_kernels.copy(dest + y * screen_w + x0, src + (y - start_y) * screen_w + (x0 - start_x), w);
+        }
+        perf_end(PERF_SCALE, perf_start);
+        return;
+    }
+    
+    // Below half size, sample from the mip level that is still at least as large as the window
+    int level = 0;
+    const uint32_t *level_src = src;
+    if (window_scaler.mips[0] != src) window_scaler_source_changed();
+    while (level + 1 < SCALE_MIP_LEVELS && scaled_w <= (screen_w >> (level + 1)) &&
+           scaled_h <= (screen_h >> (level + 1))) {
+        level++;
+        window_scaler.mips[0] = src;
+        if (level > window_scaler.mips_built) {
+            parallel_range(scaler_build_mip_rows, (void *)(intptr_t)level, screen_h >> level);
+            window_scaler.mips_built = level;
+        }
+        level_src = window_scaler.mips[level];
+    }
+    int src_w = screen_w >> level, src_h = screen_h >> level;
+    
+    ScaleFilter filter = window_scale_filter;
+    if (window_scaler.dst_w != scaled_w || window_scaler.src_w != src_w || window_scaler.filter != filter) {
+        scaler_build_axis(window_scaler.x_index, window_scaler.x_weight, scaled_w, src_w, filter);
+        window_scaler.dst_w = scaled_w;
+        window_scaler.src_w = src_w;
+    }
+    if (window_scaler.dst_h != scaled_h || window_scaler.src_h != src_h || window_scaler.filter != filter) {
+        scaler_build_axis(window_scaler.y_index, window_scaler.y_weight, scaled_h, src_h, filter);
+        window_scaler.dst_h = scaled_h;
+        window_scaler.src_h = src_h;
+    }
+    window_scaler.filter = filter;
+    
+    ScaleJob job = {dest, level_src, src_w, src_h, x0, x0 + w, y0, start_x, start_y};
+    parallel_range(filter == SCALE_NEAREST ? scale_rows_nearest : scale_rows_bilinear, &job, h);
+    perf_end(PERF_SCALE, perf_start);
+}
+
+void draw_home_screen(uint32_t *buf) {
+    clear_screen(buf, COLOR_BG);
+    draw_status_bar(buf);
+    
+    // App grid
+    int apps_per_row = 3;
+    int grid_width = apps_per_row * ICON_SIZE + (apps_per_row - 1) * MARGIN;
+    int start_x = (screen_w - grid_width) / 2;
+    int start_y = STATUS_HEIGHT + 80;
+    
+    for (int i = 0; i < num_apps; i++) {
+        int row = i / apps_per_row;
+        int col = i % apps_per_row;
+        int x = start_x + col * (ICON_SIZE + MARGIN);
+        int y = start_y + row * (ICON_SIZE + MARGIN * 2);
+        
+        draw_rounded_rect(buf, x, y, ICON_SIZE, ICON_SIZE, 40, apps[i].color);
+        
+        int text_w = measure_text_width(apps[i].name, SMALL_TEXT);
+        draw_text(buf, apps[i].name, SMALL_TEXT, x + (ICON_SIZE - text_w)/2, y + ICON_SIZE + 20, COLOR_WHITE);
+    }
+}
+
+void draw_app_screen(uint32_t *buf) {
+    clear_screen(buf, COLOR_BG);
+    draw_status_bar(buf);
+    
+    if (current_app >= 0 && current_app < num_apps) {
+        App *app = &apps[current_app];
+        
+        draw_text_centered(buf, app->name, LARGE_TEXT, STATUS_HEIGHT + 50, COLOR_WHITE);
+        
+        if (app->module) {
+            calling_app = current_app;
+            app->module->draw(buf);
+            calling_app = -1;
+        }
+    }
+    
+    // Draw home indicator on app screen
+    if (current_scale >= 0.98f && !touch.is_dragging_indicator) {
+        draw_rounded_rect(buf, screen_w/2 - 100, screen_h - 80, 200, 24, 12, COLOR_WHITE);
+    }
+}
+
+void draw_app_switcher(uint32_t *buf) {
+    clear_screen(buf, COLOR_BG);
+    draw_status_bar(buf);
+    
+    if (num_open_apps == 0) {
+        draw_text_centered(buf, "No open apps", MEDIUM_TEXT, screen_h/2, COLOR_GRAY);
+        draw_rounded_rect(buf, screen_w/2 - 100, screen_h - 80, 200, 24, 12, COLOR_WHITE);
+        return;
+    }
+    
+    draw_text_centered(buf, "Open Apps", MEDIUM_TEXT, STATUS_HEIGHT + 20, COLOR_WHITE);
+    
+    // Calculate grid layout
+    int cards_per_row = 2;
+    int card_w = 320;
+    int card_h = 200;
+    int margin_x = 60;
+    int margin_y = 40;
+    
+    int grid_width = cards_per_row * card_w + (cards_per_row - 1) * margin_x;
+    int start_x = (screen_w - grid_width) / 2;
+    int start_y = STATUS_HEIGHT + 100;
+    
+    // Draw open app cards
+    int card_index = 0;
+    for (int i = 0; i < num_apps; i++) {
+        if (!open_apps[i]) continue;
+        
+        int row = card_index / cards_per_row;
+        int col = card_index % cards_per_row;
+        int x = start_x + col * (card_w + margin_x);
+        int y = start_y + row * (card_h + margin_y);
+        
+        // Card background
+        draw_rounded_rect(buf, x, y, card_w, card_h, 20, COLOR_GRAY);
+        draw_rounded_rect(buf, x + 10, y + 10, card_w - 20, card_h - 20, 15, apps[i].color);
+        
+        int text_w = measure_text_width(apps[i].name, SMALL_TEXT);
+        AppSnapshot *snap = &app_snapshots[i];
+        if (snap->valid) {
+            // Preview of the app's last frame, name beside it
+            int thumb_y = y + (card_h - snap->h) / 2;
+            draw_rect(buf, x + 18, thumb_y - 2, snap->w + 4, snap->h + 4, COLOR_WHITE);
+            draw_image(buf, snap->pixels, snap->w, snap->h, x + 20, thumb_y);
+            
+            int text_left = x + 20 + snap->w;
+            draw_text(buf, apps[i].name, SMALL_TEXT, text_left + (x + card_w - text_left - text_w) / 2,
+                      y + card_h / 2 - SMALL_TEXT / 2, COLOR_WHITE);
+        } else {
+            // App icon area
+            int icon_x = x + (card_w - 60) / 2;
+            int icon_y = y + 40;
+            draw_rounded_rect(buf, icon_x, icon_y, 60, 60, 15, COLOR_WHITE);
+            
+            // App name
+            draw_text(buf, apps[i].name, SMALL_TEXT, x + (card_w - text_w)/2, y + card_h - 40, COLOR_WHITE);
+        }
+        
+        card_index++;
+    }
+    
+    draw_text_centered(buf, "Tap to open • Swipe up on card to close", SMALL_TEXT, screen_h - 150, COLOR_LIGHT_GRAY);
+    draw_rounded_rect(buf, screen_w/2 - 100, screen_h - 80, 200, 24, 12, COLOR_WHITE);
+}
+
+static Animation *animation_find(float *value) {
+    for (int i = 0; i < MAX_ANIMATIONS; i++) {
+        if (animations.slots[i].value == value) return &animations.slots[i];
+    }
+    return NULL;
+}
+
+// The running animation of value, or a fresh one starting from rest.
+// NULL when every slot is busy; the caller then jumps straight to the target.
+static Animation *animation_claim(float *value) {
+    Animation *a = animation_find(value);
+    if (a) return a;
+    
+    a = animation_find(NULL);
+    if (!a) return NULL;
+    // Idle time before the first animation must not count as elapsed
+    if (animations.active++ == 0) animations.now_us = input_clock_us();
+    *a = (Animation){.value = value};
+    return a;
+}
+
+// Spring *value towards target. A value already animating keeps its velocity,
+// so retargeting mid-flight bends the motion instead of restarting it.
+void animate_spring(float *value, float target, float omega, float precision, void (*done)(void)) {
+    Animation *a = animation_claim(value);
+    if (!a) {
+        *value = target;
+        if (done) done();
+        return;
+    }
+    a->target = target;
+    a->omega = omega;
+    a->precision = precision;
+    a->done = done;
+}
+
+// Move *value to target along curve over duration_ms, starting from where it is now
+void animate_ease(float *value, float target, int duration_ms, EasingCurve curve, void (*done)(void)) {
+    Animation *a = animation_claim(value);
+    if (!a) {
+        *value = target;
+        if (done) done();
+        return;
+    }
+    a->target = target;
+    a->omega = 0;
+    a->from = *value;
+    a->start_us = animations.now_us;
+    a->duration_us = duration_ms > 0 ? duration_ms * 1000ULL : 1;
+    a->curve = curve;
+    a->done = done;
+}
+
+// Hand a running spring the velocity of whatever let go of it, e.g. a finger
+void animation_fling(float *value, float velocity) {
+    Animation *a = animation_find(value);
+    if (a) a->velocity = velocity;
+}
+
+// Leave *value where it is, without running its completion. Returns the
+// velocity it had, for a gesture that takes over the motion.
+float animation_stop(float *value) {
+    Animation *a = animation_find(value);
+    if (!a) return 0;
+    float velocity = a->velocity;
+    a->value = NULL;
+    animations.active--;
+    return velocity;
+}
+
+// Non-zero while any value is still moving and frames are needed to show it
+int animations_active(void) {
+    return animations.active;
+}
+
+float ease_out_cubic(float t) {
+    float u = 1.0f - t;
+    return 1.0f - u * u * u;
+}
+
+// Advance every animation to now_us. Springs use the exact critically damped
+// solution, so the path is the same however the elapsed time is sliced into frames.
+static void animations_step(uint64_t now_us) {
+    if (animations.active == 0 || now_us <= animations.now_us) return;
+    float dt = (now_us - animations.now_us) / 1000000.0f;
+    animations.now_us = now_us;
+    
+    void (*finished[MAX_ANIMATIONS])(void);
+    int num_finished = 0;
+    for (int i = 0; i < MAX_ANIMATIONS; i++) {
+        Animation *a = &animations.slots[i];
+        if (!a->value) continue;
+        
+        int settled;
+        if (a->omega > 0) {
+            float x = *a->value - a->target;
+            float w = a->omega;
+            float c = a->velocity + w * x;
+            float decay = expf(-w * dt);
+            x = (x + c * dt) * decay;
+            a->velocity = (a->velocity - w * c * dt) * decay;
+            *a->value = a->target + x;
+            settled = fabsf(x) < a->precision && fabsf(a->velocity) < a->precision * w;
+        } else {
+            float t = (float)(now_us - a->start_us) / a->duration_us;
+            if (t > 1.0f) t = 1.0f;
+            float next = a->from + (a->target - a->from) * a->curve(t);
+            a->velocity = (next - *a->value) / dt;
+            *a->value = next;
+            settled = t >= 1.0f;
+        }
+        
+        if (settled) {
+            *a->value = a->target;
+            if (a->done) finished[num_finished++] = a->done;
+            a->value = NULL;
+            animations.active--;
+        }
+    }
+    // Completions may start new animations, so they run once the pass is over
+    for (int i = 0; i < num_finished; i++) finished[i]();
+}
+
+// Put the window back at full size, centered and at rest
+static void reset_window(void) {
+    animation_stop(&current_scale);
+    animation_stop(&window_dx);
+    animation_stop(&window_dy);
+    current_scale = 1.0f;
+    window_dx = window_dy = 0;
+}
+
+// The window's scale settled: land in the state the gesture was heading for
+static void finish_window_animation(void) {
+    if (animation_target_state == current_state) return;
+    
+    if (current_state == APP_SCREEN) {
+        capture_app_snapshot();
+        app_suspend();
+    }
+    current_state = animation_target_state;
+    if (current_state == HOME_SCREEN) reset_window();
+    printf("✅ Animation complete → %s\n", 
+        current_state == HOME_SCREEN ? "Home" : 
+        current_state == APP_SWITCHER ? "App Switcher" : "App");
+}
+
+// Send the released window to scale target, carrying on with the finger's motion
+static void release_window(float target, int drag_distance) {
+    float scale_per_px = calculate_scale_from_drag(drag_distance + 1) - calculate_scale_from_drag(drag_distance);
+    animate_spring(&current_scale, target, WINDOW_SPRING_OMEGA, SCALE_PRECISION, finish_window_animation);
+    animation_fling(&current_scale, scale_per_px * -touch.vy);
+    animate_spring(&window_dx, 0, WINDOW_SPRING_OMEGA, POSITION_PRECISION, NULL);
+    animation_fling(&window_dx, touch.vx);
+    animate_spring(&window_dy, 0, WINDOW_SPRING_OMEGA, POSITION_PRECISION, NULL);
+    animation_fling(&window_dy, touch.vy);
+}
+
+void update_animations(void) {
+    animations_step(input_clock_us());
+}
+
+// Size and place the dragged window for a finger at (x, y)
+static void update_drag(int x, int y) {
+    int drag_distance = touch.drag_start_y - y;
+    if (drag_distance >= 0) {
+        current_scale = calculate_scale_from_drag(drag_distance);
+        touch.finger_x = x;
+        touch.finger_y = y;
+        window_dx = x - screen_w/2;
+        window_dy = y - screen_h/2;
+    }
+}
+
+// Move the dragged window to where the finger should be when this frame reaches
+// the screen: the latched position extrapolated by its velocity and acceleration
+// to the expected present time, but never more than predict_ms ahead. A finger
+// that stopped sends no reports, so once it has been quiet its window settles
+// back on the latched position.
+static void predict_drag(void) {
+    touch.predicting = 0;
+    if (predict_ms <= 0 || !touch.pressed || !touch.is_dragging_indicator) return;
+    
+    uint64_t now = input_clock_us();
+    double ahead_us = (double)(now + present_lead_us) - (double)touch.sample_us;
+    if (ahead_us < 0 || now - touch.sample_us > VELOCITY_STILL_US) ahead_us = 0;
+    if (ahead_us > predict_ms * 1000.0) ahead_us = predict_ms * 1000.0;
+    touch.predicting = ahead_us > 0 && (touch.vx != 0 || touch.vy != 0);
+    
+    double dt = ahead_us / 1000000.0;
+    int x = touch.x + (int)(touch.vx * dt + 0.5 * touch.ax * dt * dt);
+    int y = touch.y + (int)(touch.vy * dt + 0.5 * touch.ay * dt * dt);
+    if (x < 0) x = 0;
+    if (x >= screen_w) x = screen_w - 1;
+    if (y < 0) y = 0;
+    if (y >= screen_h) y = screen_h - 1;
+    update_drag(x, y);
+}
+
+void handle_touch_input(void) {
+    // Handle touch press - start gesture tracking
+    if (touch.pressed && !touch.last_pressed) {
+        touch.touch_start_time = touch.last_touch_time;
+        touch.start_x = touch.x;
+        touch.start_y = touch.y;
+        touch.swipe_detected = 0;
+        touch.action_taken = 0;
+        
+        // Start home gesture tracking only from app screens
+        if ((current_state == APP_SCREEN || current_state == APP_SWITCHER) && 
+            is_touching_home_indicator(touch.x, touch.y)) {
+            touch.is_dragging_indicator = 1;
+            touch.drag_start_y = touch.y;
+            touch.finger_x = touch.x;
+            touch.finger_y = touch.y;
+            // The finger takes over from whatever the window was doing
+            animation_stop(&current_scale);
+            animation_stop(&window_dx);
+            animation_stop(&window_dy);
+            window_dx = touch.x - screen_w/2;
+            window_dy = touch.y - screen_h/2;
+            if (current_state == APP_SCREEN) capture_app_snapshot();
+            printf("🎯 Started home gesture\n");
+            return;
+        }
+    }
+    
+    // Handle dragging - update gesture progress  
+    if (touch.pressed && touch.is_dragging_indicator) {
+        update_drag(touch.x, touch.y);
+        return;
+    }
+    
+    // Handle touch release - complete gestures
+    if (!touch.pressed && touch.last_pressed) {
+        // Complete home gesture if in progress
+        if (touch.is_dragging_indicator) {
+            int final_drag = touch.drag_start_y - touch.y;
+            float threshold = screen_h * 0.15f;
+            
+            int quick_swipe = is_flick_up(touch.start_x, touch.start_y, touch.x, touch.y, touch.vx, touch.vy);
+            
+            if (final_drag > threshold || quick_swipe) {
+                AppState target = get_home_gesture_target(current_state);
+                
+                if (target != current_state) {
+                    printf("🏠 Home gesture → %s\n", 
+                           target == HOME_SCREEN ? "home" : target == APP_SWITCHER ? "app switcher" : "unknown");
+                    animation_target_state = target;
+                    release_window(0.0f, final_drag);
+                } else {
+                    printf("🏠 Home gesture ignored (same state)\n");
+                    release_window(1.0f, final_drag);
+                }
+            } else {
+                printf("↩️ Home gesture cancelled\n");
+                animation_target_state = current_state;
+                release_window(1.0f, final_drag);
+            }
+            
+            touch.is_dragging_indicator = 0;
+            return;
+        }
+        
+        // Quick swipe detection for instant gestures from app screens
+        if ((current_state == APP_SCREEN || current_state == APP_SWITCHER) &&
+            is_touching_home_indicator(touch.start_x, touch.start_y)) {
+            int quick_swipe = is_flick_up(touch.start_x, touch.start_y, touch.x, touch.y, touch.vx, touch.vy);
+            if (quick_swipe) {
+                AppState target = get_home_gesture_target(current_state);
+                if (target != current_state) {
+                    printf("🚀 Quick home swipe → %s\n", 
+                           target == HOME_SCREEN ? "home" : target == APP_SWITCHER ? "app switcher" : "unknown");
+                    animation_target_state = target;
+                    current_scale = 0.8f;
+                    animate_ease(&current_scale, 0.0f, QUICK_SWIPE_MS, ease_out_cubic, finish_window_animation);
+                }
+                return;
+            }
+        }
+    }
+    
+    // Button handling (only when not in gesture mode and not already acted)
+    if (!touch.pressed || touch.action_taken || touch.is_dragging_indicator) return;
+    
+    if (current_state == HOME_SCREEN) {
+        int apps_per_row = 3;
+        int grid_width = apps_per_row * ICON_SIZE + (apps_per_row - 1) * MARGIN;
+        int start_x = (screen_w - grid_width) / 2;
+        int start_y = STATUS_HEIGHT + 80;
+        
+        for (int i = 0; i < num_apps; i++) {
+            int row = i / apps_per_row;
+            int col = i % apps_per_row;
+            int icon_x = start_x + col * (ICON_SIZE + MARGIN);
+            int icon_y = start_y + row * (ICON_SIZE + MARGIN * 2);
+            
+            if (touch.x >= (icon_x - 50) && touch.x < (icon_x + ICON_SIZE + 50) &&
+                touch.y >= (icon_y - 50) && touch.y < (icon_y + ICON_SIZE + 50)) {
+                touch.action_taken = 1;
+                if (show_app(i)) printf("🚀 Launched: %s\n", apps[i].name);
+                return;
+            }
+        }
+    } else if (current_state == APP_SWITCHER) {
+        if (num_open_apps == 0) return;
+        
+        int cards_per_row = 2;
+        int card_w = 320;
+        int card_h = 200;
+        int margin_x = 60;
+        int margin_y = 40;
+        
+        int grid_width = cards_per_row * card_w + (cards_per_row - 1) * margin_x;
+        int start_x = (screen_w - grid_width) / 2;
+        int start_y = STATUS_HEIGHT + 100;
+        
+        int card_index = 0;
+        for (int i = 0; i < num_apps; i++) {
+            if (!open_apps[i]) continue;
+            
+            int row = card_index / cards_per_row;
+            int col = card_index % cards_per_row;
+            int x = start_x + col * (card_w + margin_x);
+            int y = start_y + row * (card_h + margin_y);
+            
+            if (touch.x >= x && touch.x < (x + card_w) &&
+                touch.y >= y && touch.y < (y + card_h)) {
+                touch.action_taken = 1;
+                
+                int swipe_dy = touch.start_y - touch.y;
+                if (swipe_dy > 100 && (touch.last_touch_time - touch.touch_start_time) < 500) {
+                    remove_open_app(i);
+                    printf("❌ Closed app: %s\n", apps[i].name);
+                    
+                    if (num_open_apps == 0) {
+                        current_state = HOME_SCREEN;
+                        animation_target_state = HOME_SCREEN;
+                    }
+                    return;
+                } else {
+                    if (show_app(i)) printf("🚀 Opened app: %s\n", apps[i].name);
+                    return;
+                }
+            }
+            
+            card_index++;
+        }
+    } else if (current_state == APP_SCREEN && current_app >= 0) {
+        const AppModule *module = apps[current_app].module;
+        if (module && module->touch) {
+            calling_app = current_app;
+            module->touch(touch.x, touch.y, touch.pressed, touch.last_pressed);
+            calling_app = -1;
+        }
+    }
+}
+
+// Fit p(t) = a + b t + c t^2 by least squares over the contact's samples from
+// the last VELOCITY_WINDOW_US, with t in ms relative to now. Velocity at now is
+// b and acceleration 2c. With fewer than three usable samples the fit falls
+// back to a line, and with fewer than two the contact reads as still.
+static void estimate_velocity(TouchContact *c, uint64_t now_us) {
+    double s[5] = {0}, sx[3] = {0}, sy[3] = {0};
+    int n = 0;
+    c->vx = c->vy = c->ax = c->ay = 0;
+    
+    for (int i = 0; i < c->history_len; i++) {
+        int index = (c->history_head - 1 - i + VELOCITY_SAMPLES) % VELOCITY_SAMPLES;
+        uint64_t age = now_us - c->history[index].time_us;
+        if (age > (i == 0 ? VELOCITY_STILL_US : VELOCITY_WINDOW_US)) break;
+        
+        double t = -(double)age / 1000.0, tp = 1.0;
+        for (int k = 0; k < 5; k++) {
+            s[k] += tp;
+            if (k < 3) {
+                sx[k] += tp * c->history[index].x;
+                sy[k] += tp * c->history[index].y;
+            }
+            tp *= t;
+        }
+        n++;
+    }
+    if (n < 2) return;
+    
+    // Normal equations: [s0 s1 s2; s1 s2 s3; s2 s3 s4] [a b c] = [sx0 sx1 sx2]
+    double det3 = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2]) +
+                  s[2] * (s[1] * s[3] - s[2] * s[2]);
+    if (n >= 3 && fabs(det3) > 1e-9 * s[0] * s[2] * s[4]) {
+        double *rhs[2] = {sx, sy};
+        float *vel[2] = {&c->vx, &c->vy}, *acc[2] = {&c->ax, &c->ay};
+        for (int axis = 0; axis < 2; axis++) {
+            double *r = rhs[axis];
+            double b = (s[0] * (r[1] * s[4] - s[3] * r[2]) - r[0] * (s[1] * s[4] - s[3] * s[2]) +
+                        s[2] * (s[1] * r[2] - r[1] * s[2])) / det3;
+            double cc = (s[0] * (s[2] * r[2] - r[1] * s[3]) - s[1] * (s[1] * r[2] - r[1] * s[2]) +
+                         r[0] * (s[1] * s[3] - s[2] * s[2])) / det3;
+            *vel[axis] = b * 1000.0;
+            *acc[axis] = 2.0 * cc * 1000000.0;
+        }
+        return;
+    }
+    
+    double det2 = s[0] * s[2] - s[1] * s[1];
+    if (fabs(det2) <= 1e-9 * s[0] * s[2]) return;
+    c->vx = (s[0] * sx[1] - s[1] * sx[0]) / det2 * 1000.0;
+    c->vy = (s[0] * sy[1] - s[1] * sy[0]) / det2 * 1000.0;
+}
+
+// Update one contact from a queued sample
+static void apply_contact(int slot, int x, int y, int pressed, uint64_t time_us) {
+    if (slot < 0 || slot >= MAX_TOUCH_SLOTS) return;
+    TouchContact *c = &touch_contacts[slot];
+    
+    if (pressed) {
+        if (!c->active) {
+            c->active = c->went_down = 1;
+            c->down_us = time_us;
+            c->history_len = 0;
+        }
+        c->x = x;
+        c->y = y;
+        c->history[c->history_head] = (TouchPoint){x, y, time_us};
+        c->history_head = (c->history_head + 1) % VELOCITY_SAMPLES;
+        if (c->history_len < VELOCITY_SAMPLES) c->history_len++;
+    } else {
+        c->active = 0;
+    }
+    estimate_velocity(c, time_us);
+}
+
+// Latch a complete report into touch. The gesture code follows one primary
+// contact: the earliest finger to land while none was primary. Fingers already
+// down when it lifts don't take over, so the point never jumps between them.
+static void latch_touch_report(uint64_t time_us) {
+    if (touch.primary_slot < 0) {
+        for (int i = 0; i < MAX_TOUCH_SLOTS; i++) {
+            TouchContact *c = &touch_contacts[i];
+            if (c->active && c->went_down &&
+                (touch.primary_slot < 0 || c->down_us < touch_contacts[touch.primary_slot].down_us)) {
+                touch.primary_slot = i;
+            }
+        }
+    }
+    for (int i = 0; i < MAX_TOUCH_SLOTS; i++) touch_contacts[i].went_down = 0;
+    
+    touch.last_pressed = touch.pressed;
+    touch.last_touch_time = time_us / 1000;
+    touch.sample_us = time_us;
+    if (touch.primary_slot < 0) {
+        touch.pressed = 0;
+        return;
+    }
+    
+    TouchContact *c = &touch_contacts[touch.primary_slot];
+    touch.pressed = c->active;
+    touch.x = c->x;
+    touch.y = c->y;
+    touch.vx = c->vx;
+    touch.vy = c->vy;
+    touch.ax = c->ax;
+    touch.ay = c->ay;
+    if (!c->active) touch.primary_slot = -1;
+}
+
+// Apply a one-finger touch report, from a script
+void apply_touch_frame(int x, int y, int pressed, uint64_t time_ms) {
+    apply_contact(0, x, y, pressed, time_ms * 1000);
+    latch_touch_report(time_ms * 1000);
+}
+
+// Input thread side: returns 0 and counts the sample if the UI thread has fallen a whole ring behind
+static int input_ring_push(const TouchSample *sample) {
+    uint32_t head = input_ring.head;
+    uint32_t tail = __atomic_load_n(&input_ring.tail, __ATOMIC_ACQUIRE);
+    if (head - tail == INPUT_RING_SIZE) {
+        __atomic_fetch_add(&input_ring.dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    
+    input_ring.samples[head & (INPUT_RING_SIZE - 1)] = *sample;
+    __atomic_store_n(&input_ring.head, head + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&input_ring.pushed, 1, __ATOMIC_RELAXED);
+    if (head + 1 - tail > input_ring.high_water) {
+        __atomic_store_n(&input_ring.high_water, head + 1 - tail, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+// UI thread side
+static int input_ring_pop(TouchSample *sample) {
+    uint32_t tail = input_ring.tail;
+    if (__atomic_load_n(&input_ring.head, __ATOMIC_ACQUIRE) == tail) return 0;
+    
+    *sample = input_ring.samples[tail & (INPUT_RING_SIZE - 1)];
+    __atomic_store_n(&input_ring.tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int bit_is_set(const unsigned long *bits, int bit) {
+    return (bits[bit / (8 * sizeof(long))] >> (bit % (8 * sizeof(long)))) & 1;
+}
+
+static int device_to_screen_x(const TouchDevice *dev, int value) {
+    return (value - dev->min_x) * screen_w / (dev->max_x - dev->min_x + 1);
+}
+
+static int device_to_screen_y(const TouchDevice *dev, int value) {
+    return (value - dev->min_y) * screen_h / (dev->max_y - dev->min_y + 1);
+}
+
+// Move a slot to its state as read back from the device, marking it dirty if that differs
+static void resync_slot(DeviceSlot *slot, int tracking, int x, int y) {
+    if (tracking == slot->tracking && (!tracking || (x == slot->x && y == slot->y))) return;
+    slot->tracking = tracking;
+    if (tracking) {
+        slot->x = x;
+        slot->y = y;
+    }
+    slot->dirty = 1;
+}
+
+// Re-read a device's contacts after the kernel dropped events. A lift lost
+// in the overrun would otherwise leave its contact pressed for good.
+static void resync_touch_device(TouchDevice *dev) {
+    if (dev->multitouch) {
+        int32_t ids[1 + MAX_TOUCH_SLOTS] = {ABS_MT_TRACKING_ID};
+        int32_t xs[1 + MAX_TOUCH_SLOTS] = {ABS_MT_POSITION_X};
+        int32_t ys[1 + MAX_TOUCH_SLOTS] = {ABS_MT_POSITION_Y};
+        struct input_absinfo slot;
+        if (ioctl(dev->fd, EVIOCGMTSLOTS(sizeof(ids)), ids) < 0 ||
+            ioctl(dev->fd, EVIOCGMTSLOTS(sizeof(xs)), xs) < 0 ||
+            ioctl(dev->fd, EVIOCGMTSLOTS(sizeof(ys)), ys) < 0 ||
+            ioctl(dev->fd, EVIOCGABS(ABS_MT_SLOT), &slot) < 0) {
+            return;
+        }
+        for (int i = 0; i < MAX_TOUCH_SLOTS; i++) {
+            resync_slot(&dev->slots[i], ids[i + 1] >= 0,
+                        device_to_screen_x(dev, xs[i + 1]), device_to_screen_y(dev, ys[i + 1]));
+        }
+        dev->slot = slot.value;
+    } else {
+        unsigned long keys[KEY_CNT / (8 * sizeof(long)) + 1] = {0};
+        struct input_absinfo abs_x, abs_y;
+        if (ioctl(dev->fd, EVIOCGKEY(sizeof(keys)), keys) < 0 ||
+            ioctl(dev->fd, EVIOCGABS(ABS_X), &abs_x) < 0 ||
+            ioctl(dev->fd, EVIOCGABS(ABS_Y), &abs_y) < 0) {
+            return;
+        }
+        resync_slot(&dev->slots[0], bit_is_set(keys, BTN_TOUCH),
+                    device_to_screen_x(dev, abs_x.value), device_to_screen_y(dev, abs_y.value));
+    }
+}
+
+// Fold one evdev event into the device's slots. On SYN_REPORT, queue a sample
+// for every slot that changed; returns the number queued. Single-touch devices,
+// and multitouch devices without slots, drive slot 0 from ABS_X/ABS_Y and
+// BTN_TOUCH. Type A ABS_MT_* events are ignored: they don't say which contact
+// they belong to, so a second finger would take over the first one's point.
+static int touch_device_event(TouchDevice *dev, const struct input_event *ev) {
+    int in_range = dev->slot >= 0 && dev->slot < MAX_TOUCH_SLOTS;
+    DeviceSlot *slot = dev->multitouch ? (in_range ? &dev->slots[dev->slot] : NULL) : &dev->slots[0];
+    
+    // After an overrun the kernel sends SYN_DROPPED; everything up to the next
+    // SYN_REPORT is a partial report, and the device is read back instead
+    if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+        dev->dropped = 1;
+        return 0;
+    }
+    if (dev->dropped) {
+        if (ev->type != EV_SYN || ev->code != SYN_REPORT) return 0;
+        dev->dropped = 0;
+        __atomic_fetch_add(&input_ring.resyncs, 1, __ATOMIC_RELAXED);
+        resync_touch_device(dev);
+    }
+    
+    if (ev->type == EV_ABS) {
+        if (ev->code == ABS_MT_SLOT) {
+            dev->slot = ev->value;
+        } else if (!slot) {
+            // Slot beyond MAX_TOUCH_SLOTS
+        } else if (dev->multitouch ? ev->code == ABS_MT_POSITION_X : ev->code == ABS_X) {
+            slot->x = device_to_screen_x(dev, ev->value);
+            slot->dirty = 1;
+        } else if (dev->multitouch ? ev->code == ABS_MT_POSITION_Y : ev->code == ABS_Y) {
+            slot->y = device_to_screen_y(dev, ev->value);
+            slot->dirty = 1;
+        } else if (dev->multitouch && ev->code == ABS_MT_TRACKING_ID) {
+            slot->tracking = ev->value >= 0;
+            slot->dirty = 1;
+        }
+    } else if (ev->type == EV_KEY && ev->code == BTN_TOUCH && !dev->multitouch) {
+        slot->tracking = ev->value;
+        slot->dirty = 1;
+    } else if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+        uint64_t time_us = dev->kernel_clock ? ev->time.tv_sec * 1000000ULL + ev->time.tv_usec : input_clock_us();
+        
+        int last = -1, queued = 0;
+        for (int i = 0; i < MAX_TOUCH_SLOTS; i++) {
+            if (dev->slots[i].dirty) last = i;
+        }
+        for (int i = 0; i <= last; i++) {
+            DeviceSlot *s = &dev->slots[i];
+            if (!s->dirty) continue;
+            TouchSample sample = {s->x, s->y, s->tracking, i, i == last, time_us};
+            queued += input_ring_push(&sample);
+            s->dirty = 0;
+        }
+        return queued;
+    }
+    return 0;
+}
+
+// Decide from capability bits whether a device is a touchscreen. Touchscreens
+// set INPUT_PROP_DIRECT: their positions map onto the display. Touchpads set
+// INPUT_PROP_POINTER and are skipped. Drivers that set neither prop still count
+// if they report touch contacts.
+static DeviceClass classify_input_device(int fd) {
+    unsigned long props[INPUT_PROP_CNT / (8 * sizeof(long)) + 1] = {0};
+    unsigned long abs[ABS_CNT / (8 * sizeof(long)) + 1] = {0};
+    unsigned long keys[KEY_CNT / (8 * sizeof(long)) + 1] = {0};
+    ioctl(fd, EVIOCGPROP(sizeof(props)), props);
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs)), abs) < 0) return DEVICE_IGNORED;
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+    
+    int direct = bit_is_set(props, INPUT_PROP_DIRECT);
+    if (!direct && bit_is_set(props, INPUT_PROP_POINTER)) return DEVICE_IGNORED;
+    if (!direct && !bit_is_set(keys, BTN_TOUCH)) return DEVICE_IGNORED;
+    
+    if (bit_is_set(abs, ABS_MT_POSITION_X) && bit_is_set(abs, ABS_MT_POSITION_Y)) {
+        return bit_is_set(abs, ABS_MT_SLOT) ? DEVICE_MULTITOUCH_B : DEVICE_MULTITOUCH_A;
+    }
+    if (bit_is_set(abs, ABS_X) && bit_is_set(abs, ABS_Y)) return DEVICE_SINGLE_TOUCH;
+    return DEVICE_IGNORED;
+}
+
+static int find_touch_device(const char *name) {
+    for (int i = 0; i < MAX_TOUCH_DEVICES; i++) {
+        if (touch_devices[i].fd >= 0 && strcmp(touch_devices[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// Open /dev/input/NAME and start reading it if it is a touchscreen. Runs at
+// startup and on the input thread whenever a node appears or changes mode.
+static void open_touch_device(const char *name) {
+    static const char *class_names[] = {"ignored", "single touch", "multitouch (type A)", "multitouch"};
+    if (strncmp(name, "event", 5) != 0 || strlen(name) >= sizeof(touch_devices[0].name)) return;
+    if (find_touch_device(name) >= 0) return;
+    
+    int index = -1;
+    for (int i = 0; i < MAX_TOUCH_DEVICES && index < 0; i++) {
+        if (touch_devices[i].fd < 0) index = i;
+    }
+    if (index < 0) return;
+    
+    // Fails until udev has set permissions on a new node; IN_ATTRIB retries
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/input/%s", name);
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return;
+    
+    // Type A contacts are read through the ABS_X/BTN_TOUCH emulation their
+    // drivers also report, which tracks the first finger; see touch_device_event
+    DeviceClass type = classify_input_device(fd);
+    int multitouch = type == DEVICE_MULTITOUCH_B;
+    struct input_absinfo abs_x, abs_y, abs_slot = {0};
+    if (type == DEVICE_IGNORED ||
+        ioctl(fd, EVIOCGABS(multitouch ? ABS_MT_POSITION_X : ABS_X), &abs_x) < 0 ||
+        ioctl(fd, EVIOCGABS(multitouch ? ABS_MT_POSITION_Y : ABS_Y), &abs_y) < 0) {
+        close(fd);
+        return;
+    }
+    if (type == DEVICE_MULTITOUCH_B) ioctl(fd, EVIOCGABS(ABS_MT_SLOT), &abs_slot);
+    
+    // Ask for monotonic event timestamps so they compare with get_time_ms
+    int clock_id = CLOCK_MONOTONIC;
+    int kernel_clock = ioctl(fd, EVIOCSCLOCKID, &clock_id) == 0;
+    
+    TouchDevice *dev = &touch_devices[index];
+    *dev = (TouchDevice){
+        .fd = fd, .min_x = abs_x.minimum, .max_x = abs_x.maximum,
+        .min_y = abs_y.minimum, .max_y = abs_y.maximum,
+        .multitouch = multitouch, .slot = abs_slot.value, .kernel_clock = kernel_clock
+    };
+    strcpy(dev->name, name);
+    
+    struct epoll_event ev = {.events = EPOLLIN};
+    ev.data.u32 = index;
+    if (epoll_ctl(input_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        close(fd);
+        dev->fd = -1;
+        return;
+    }
+    printf("🖐️ %s: %s\n", path, class_names[type]);
+}
+
+// Forget a device that went away. Contacts it had down are released through
+// the ring so the UI never keeps a finger pressed that can't lift.
+static void close_touch_device(int index) {
+    TouchDevice *dev = &touch_devices[index];
+    epoll_ctl(input_epoll_fd, EPOLL_CTL_DEL, dev->fd, NULL);
+    close(dev->fd);
+    dev->fd = -1;
+    
+    int last = -1;
+    for (int i = 0; i < MAX_TOUCH_SLOTS; i++) {
+        if (dev->slots[i].tracking) last = i;
+    }
+    uint64_t time_us = input_clock_us();
+    for (int i = 0; i <= last; i++) {
+        if (!dev->slots[i].tracking) continue;
+        TouchSample sample = {dev->slots[i].x, dev->slots[i].y, 0, i, i == last, time_us};
+        input_ring_push(&sample);
+    }
+    if (last >= 0) wake_main_loop();
+    printf("🔌 /dev/input/%s removed\n", dev->name);
+}
+
+// Apply /dev/input changes: new nodes are probed, deleted ones closed
+static void handle_input_hotplug(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    
+    while ((len = read(input_inotify_fd, buf, sizeof(buf))) > 0) {
+        const struct inotify_event *ev;
+        for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *)p;
+            if (ev->len == 0) continue;
+            if (ev->mask & IN_DELETE) {
+                int index = find_touch_device(ev->name);
+                if (index >= 0) close_touch_device(index);
+            } else if (ev->mask & (IN_CREATE | IN_ATTRIB)) {
+                open_touch_device(ev->name);
+            }
+        }
+    }
+}
+
+// Read everything a device has buffered, a batch of events per syscall.
+// A device that fails the read (ENODEV once unplugged) is closed.
+static int drain_touch_device(TouchDevice *dev) {
+    struct input_event events[INPUT_READ_BATCH];
+    int queued = 0;
+    ssize_t got;
+    
+    while ((got = read(dev->fd, events, sizeof(events))) > 0) {
+        __atomic_fetch_add(&input_ring.reads, 1, __ATOMIC_RELAXED);
+        int count = got / sizeof(events[0]);
+        for (int i = 0; i < count; i++) {
+            queued += touch_device_event(dev, &events[i]);
+        }
+        // A short read means the buffer is empty; epoll will say when it isn't
+        if (count < INPUT_READ_BATCH) break;
+    }
+    if (got < 0 && errno != EAGAIN && errno != EINTR) close_touch_device(dev - touch_devices);
+    return queued;
+}
+
+// Watch /dev/input and open every touchscreen already there. Devices and the
+// watch share the input thread's epoll set, so hotplug costs nothing until a
+// node actually changes.
+void init_touch_devices(void) {
+    for (int i = 0; i < MAX_TOUCH_DEVICES; i++) {
+        touch_devices[i].fd = -1;
+    }
+    
+    input_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (input_epoll_fd < 0) { perror("epoll_create1 failed"); exit(1); }
+    
+    // Watch before scanning so a node created in between isn't missed
+    input_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (input_inotify_fd >= 0 &&
+        inotify_add_watch(input_inotify_fd, "/dev/input", IN_CREATE | IN_DELETE | IN_ATTRIB) >= 0) {
+        struct epoll_event ev = {.events = EPOLLIN};
+        ev.data.u32 = INPUT_HOTPLUG_ID;
+        epoll_ctl(input_epoll_fd, EPOLL_CTL_ADD, input_inotify_fd, &ev);
+    } else {
+        perror("Input hotplug watch failed");
+        if (input_inotify_fd >= 0) close(input_inotify_fd);
+        input_inotify_fd = -1;
+    }
+    
+    DIR *dir = opendir("/dev/input");
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        open_touch_device(entry->d_name);
+    }
+    closedir(dir);
+}
+
+// Sleeps in epoll on the touch devices and the hotplug watch, queues reports
+// the moment they arrive and wakes the main loop, however long the current
+// frame takes
+static void *input_thread_main(void *arg) {
+    struct epoll_event ready[16];
+    for (;;) {
+        int n = epoll_wait(input_epoll_fd, ready, 16, -1);
+        int queued = 0;
+        for (int i = 0; i < n; i++) {
+            uint32_t id = ready[i].data.u32;
+            if (id == INPUT_HOTPLUG_ID) {
+                handle_input_hotplug();
+            } else if (touch_devices[id].fd >= 0) {
+                queued += drain_touch_device(&touch_devices[id]);
+            }
+        }
+        if (queued > 0) wake_main_loop();
+    }
+    return NULL;
+}
+
+void init_input_thread(void) {
+    if (input_inotify_fd < 0) {
+        int devices = 0;
+        for (int i = 0; i < MAX_TOUCH_DEVICES; i++) {
+            devices += touch_devices[i].fd >= 0;
+        }
+        if (devices == 0) return;
+    }
     
-    return scale;
+    if (pthread_create(&input_thread, NULL, input_thread_main, NULL) != 0) {
+        perror("Input thread creation failed");
+        exit(1);
+    }
 }
 
-int is_quick_swipe_up(int start_x, int start_y, int end_x, int end_y, uint64_t duration) {
-    int dx = end_x - start_x;
-    int dy = start_y - end_y;
-    int distance = sqrt(dx*dx + dy*dy);
+void input_ring_print_stats(void) {
+    printf("🖐️ Input ring: %llu samples in %llu reads, %llu dropped, %llu resyncs, peak depth %u/%d\n",
+           (unsigned long long)__atomic_load_n(&input_ring.pushed, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&input_ring.reads, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&input_ring.dropped, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&input_ring.resyncs, __ATOMIC_RELAXED),
+           __atomic_load_n(&input_ring.high_water, __ATOMIC_RELAXED), INPUT_RING_SIZE);
+}
+
+// Apply every queued touch report in order, running gesture handling on each.
+// Returns the number of reports applied.
+int read_touch_events(void) {
+    TouchSample sample;
+    int frames = 0;
     
-    return (dy > SWIPE_THRESHOLD && 
-            duration <= SWIPE_TIME_LIMIT && 
-            distance > SWIPE_THRESHOLD &&
-            dy > abs(dx));
+    while (input_ring_pop(&sample)) {
+        if (frames == 0 && perf_active()) {
+            int64_t age = (int64_t)(perf_now_ns() - sample.time_us * 1000);
+            perf.stage_ns[PERF_INPUT] = age > 0 ? (uint64_t)age : 1;
+        }
+        apply_contact(sample.slot, sample.x, sample.y, sample.pressed, sample.time_us);
+        if (!sample.end_of_report) continue;
+        
+        latch_touch_report(sample.time_us);
+        handle_touch_input();
+        if (perf_active()) perf.unpresented_input_us = sample.time_us;
+        frames++;
+    }
+    return frames;
 }
 
-void apply_fast_blur(uint32_t *buf, float blur_amount) {
-    if (blur_amount < 0.1f) return;
+void init_event_loop(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) { perror("epoll_create1 failed"); exit(1); }
     
-    int darken = (int)(blur_amount * 40);
+    frame_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (frame_timer_fd < 0) { perror("timerfd_create failed"); exit(1); }
     
-    for (int i = 0; i < screen_w * screen_h; i++) {
-        uint32_t pixel = buf[i];
-        int r = ((pixel >> 16) & 0xFF);
-        int g = ((pixel >> 8) & 0xFF);
-        int b = (pixel & 0xFF);
-        
-        r = (r > darken) ? r - darken : 0;
-        g = (g > darken) ? g - darken : 0;
-        b = (b > darken) ? b - darken : 0;
-        
-        buf[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) { perror("eventfd failed"); exit(1); }
+    
+    struct epoll_event ev = {.events = EPOLLIN};
+    ev.data.fd = frame_timer_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, frame_timer_fd, &ev);
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+// Run the periodic frame timer only while something is animating
+void set_frame_timer(int active) {
+    if (active == frame_timer_armed) return;
+    
+    struct itimerspec spec = {0};
+    if (active) {
+        spec.it_interval.tv_nsec = FRAME_INTERVAL_NS;
+        spec.it_value.tv_nsec = FRAME_INTERVAL_NS;
     }
+    timerfd_settime(frame_timer_fd, 0, &spec, NULL);
+    frame_timer_armed = active;
 }
 
-void draw_scaled_window(uint32_t *dest, uint32_t *src, float scale, int finger_x, int finger_y) {
-    int scaled_w = (int)(screen_w * scale);
-    int scaled_h = (int)(screen_h * scale);
+// Safe to call from any thread: makes the main loop run one iteration
+void wake_main_loop(void) {
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Counter saturated - the loop is already due to wake up
+    }
+}
+
+// The status bar clock is the only thing that changes with no event behind it
+int ms_until_next_minute(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int)(60000 - (ts.tv_sec % 60) * 1000 - ts.tv_nsec / 1000000) + 1;
+}
+
+// Block until input, a frame tick, a wakeup or the timeout
+LoopEvents wait_for_events(int timeout_ms) {
+    LoopEvents events = {0};
+    struct epoll_event ready[MAX_LOOP_EVENTS];
     
-    // Position window so its bottom center is at the finger position
-    int center_x = finger_x;
-    int bottom_y = finger_y;
+    int n = epoll_wait(epoll_fd, ready, MAX_LOOP_EVENTS, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        int fd = ready[i].data.fd;
+        uint64_t count;
+        if (fd == frame_timer_fd) {
+            if (read(frame_timer_fd, &count, sizeof(count)) == sizeof(count)) {
+                events.frame_ticks = count > MAX_CATCHUP_FRAMES ? MAX_CATCHUP_FRAMES : (int)count;
+            }
+        } else if (fd == wake_fd) {
+            if (read(wake_fd, &count, sizeof(count)) == sizeof(count)) events.woken = 1;
+        }
+    }
+    return events;
+}
+
+static void draw_screen(uint32_t *buf, AppState state) {
+    switch (state) {
+        case HOME_SCREEN: draw_home_screen(buf); break;
+        case APP_SCREEN: draw_app_screen(buf); break;
+        case APP_SWITCHER: draw_app_switcher(buf); break;
+    }
+}
+
+// Record one of the shell's screens without rasterizing it
+void record_screen(DisplayList *list, AppState state) {
+    dl_begin(list);
+    draw_screen(NULL, state);
+    dl_end();
+}
+
+// Gesture frames composite a scaled window over a background instead of showing a screen
+static int is_gesture_frame(void) {
+    return current_scale < 0.98f || touch.is_dragging_indicator || window_dx != 0 || window_dy != 0;
+}
+
+// Run-length encode pixels into a surface, falling back to a plain copy when
+// runs would be larger. UI screens are mostly flat fills and shrink 10-50x.
+static int surface_compress(AppSurface *surface, const uint32_t *pixels, size_t count) {
+    size_t capacity = 4096, used = 0;
+    uint32_t *runs = malloc(capacity * sizeof(uint32_t));
+    for (size_t i = 0; runs && i < count; ) {
+        size_t j = i + 1;
+        while (j < count && pixels[j] == pixels[i] && j - i < UINT32_MAX) j++;
+        if (used + 2 > capacity) {
+            if (capacity >= count) {
+                free(runs);
+                runs = NULL;
+                break;
+            }
+            uint32_t *grown = realloc(runs, capacity * 2 * sizeof(uint32_t));
+            if (!grown) {
+                free(runs);
+                runs = NULL;
+                break;
+            }
+            runs = grown;
+            capacity *= 2;
+        }
+        runs[used++] = j - i;
+        runs[used++] = pixels[i];
+        i = j;
+    }
     
-    // Keep window on screen horizontally
-    if (center_x - scaled_w/2 < 0) center_x = scaled_w/2;
-    if (center_x + scaled_w/2 > screen_w) center_x = screen_w - scaled_w/2;
+    surface->raw = runs == NULL;
+    if (surface->raw) {
+        used = count;
+        runs = malloc(count * sizeof(uint32_t));
+        if (!runs) return 0;
+        memcpy(runs, pixels, count * sizeof(uint32_t));
+    } else {
+        uint32_t *shrunk = realloc(runs, used * sizeof(uint32_t));
+        if (shrunk) runs = shrunk;
+    }
+    surface->runs = runs;
+    surface->bytes = used * sizeof(uint32_t);
+    return 1;
+}
+
+static void surface_decompress(const AppSurface *surface, uint32_t *pixels, size_t count) {
+    if (surface->raw) {
+        pixel_kernels.copy(pixels, surface->runs, count);
+        return;
+    }
+    for (size_t i = 0; i < surface->bytes / sizeof(uint32_t); i += 2) {
+        pixel_kernels.fill(pixels, surface->runs[i + 1], surface->runs[i]);
+        pixels += surface->runs[i];
+    }
+}
+
+static void surface_drop(AppSurface *surface) {
+    free(surface->runs);
+    surface_pool.used -= surface->bytes;
+    surface->runs = NULL;
+    surface->bytes = 0;
+    surface->list.valid = 0;
+}
+
+// Forget a closed app's pixels
+void surface_release(int app_id) {
+    surface_drop(&surface_pool.surfaces[app_id]);
+    if (surface_pool.owner == app_id) {
+        surface_pool.owner = -1;
+        app_lists[app_list].valid = 0;
+    }
+}
+
+// Evict least recently used background surfaces until the pool fits its budget
+static void surface_pool_trim(void) {
+    while (surface_pool.used > surface_pool.budget) {
+        AppSurface *victim = NULL;
+        for (int i = 0; i < num_apps; i++) {
+            AppSurface *surface = &surface_pool.surfaces[i];
+            if (surface->runs && (!victim || surface->last_used < victim->last_used)) victim = surface;
+        }
+        if (!victim) return;
+        surface_drop(victim);
+        surface_pool.evictions++;
+    }
+}
+
+// Give app_buffer to APP_ID. The previous owner's pixels and list move into its
+// surface; APP_ID's come back out of its surface if it still has one, so
+// switching to a recent app costs a decompress instead of a full re-render.
+static void surface_switch(int app_id) {
+    size_t count = (size_t)screen_w * screen_h;
+    int previous = surface_pool.owner;
+    if (previous >= 0 && open_apps[previous] && app_lists[app_list].valid) {
+        AppSurface *surface = &surface_pool.surfaces[previous];
+        surface_drop(surface);
+        if (surface_compress(surface, app_buffer, count)) {
+            DisplayList list = surface->list;
+            surface->list = app_lists[app_list];
+            app_lists[app_list] = list;
+            surface->last_used = ++surface_pool.clock;
+            surface_pool.used += surface->bytes;
+        }
+    }
+    app_lists[app_list].valid = 0;
     
-    // Keep window on screen vertically (bottom anchored)
-    if (bottom_y - scaled_h < 0) bottom_y = scaled_h;
-    if (bottom_y > screen_h) bottom_y = screen_h;
+    AppSurface *surface = &surface_pool.surfaces[app_id];
+    if (surface->runs) {
+        surface_decompress(surface, app_buffer, count);
+        DisplayList list = app_lists[app_list];
+        app_lists[app_list] = surface->list;
+        surface->list = list;
+        surface_drop(surface);
+        surface_pool.restores++;
+    } else {
+        surface_pool.rerenders++;
+    }
+    surface_pool.owner = app_id;
+    surface_pool_trim();
+    window_scaler_source_changed();
+}
+
+void surface_pool_print_stats(FILE *out) {
+    fprintf(out, "🗂️ App surfaces: %zu/%zu KB in background, %llu restored, %llu re-rendered, %llu evicted\n",
+            surface_pool.used / 1024, surface_pool.budget / 1024, (unsigned long long)surface_pool.restores,
+            (unsigned long long)surface_pool.rerenders, (unsigned long long)surface_pool.evictions);
+    size_t screen_bytes = (size_t)screen_w * screen_h * 4;
+    for (int i = 0; i < num_apps; i++) {
+        const AppSurface *surface = &surface_pool.surfaces[i];
+        if (surface_pool.owner == i) {
+            fprintf(out, "   %-16s foreground %8zu KB\n", apps[i].name, screen_bytes / 1024);
+        } else if (surface->runs) {
+            fprintf(out, "   %-16s %-10s %8zu KB  %.1fx\n", apps[i].name, surface->raw ? "raw" : "compressed",
+                    surface->bytes / 1024, (double)screen_bytes / surface->bytes);
+        } else if (open_apps[i]) {
+            fprintf(out, "   %-16s evicted\n", apps[i].name);
+        }
+    }
+}
+
+// Bring app_buffer up to date with the current screen, re-rasterizing only what
+// records differently. Changed areas are added to DAMAGE if it isn't NULL.
+static void update_app_buffer(DamageList *damage) {
+    if (current_app >= 0 && surface_pool.owner != current_app) surface_switch(current_app);
     
-    int start_x = center_x - scaled_w/2;
-    int start_y = bottom_y - scaled_h;
+    DisplayList *next = &app_lists[app_list ^ 1];
+    record_screen(next, current_state);
+    DamageList changed = {.count = 0};
+    if (dl_diff(&app_lists[app_list], next, &changed) == 0) return;
     
-    for (int y = 0; y < scaled_h; y++) {
-        int dest_y = start_y + y;
-        if (dest_y < 0 || dest_y >= screen_h) continue;
-        
-        int src_y = (int)(y / scale);
-        if (src_y >= screen_h) continue;
-        
-        for (int x = 0; x < scaled_w; x++) {
-            int dest_x = start_x + x;
-            if (dest_x < 0 || dest_x >= screen_w) continue;
-            
-            int src_x = (int)(x / scale);
-            if (src_x >= screen_w) continue;
-            
-            dest[dest_y * screen_w + dest_x] = src[src_y * screen_w + src_x];
+    Rect saved_clip = clip_rect;
+    for (int i = 0; i < changed.count; i++) {
+        clip_rect = changed.rects[i];
+        dl_execute(next, app_buffer);
+        if (damage) damage_add(damage, clip_rect.x, clip_rect.y, clip_rect.w, clip_rect.h);
+    }
+    clip_rect = saved_clip;
+    app_list ^= 1;
+    window_scaler_source_changed();
+}
+
+typedef struct {
+    const uint32_t *src;
+    AppSnapshot *snap;
+} ThumbJob;
+
+// Box-filter app_buffer rows down into the thumbnail
+static void thumb_rows(void *ctx, int start, int end) {
+    ThumbJob *job = ctx;
+    AppSnapshot *snap = job->snap;
+    for (int ty = start; ty < end; ty++) {
+        int y0 = ty * screen_h / snap->h, y1 = (ty + 1) * screen_h / snap->h;
+        for (int tx = 0; tx < snap->w; tx++) {
+            int x0 = tx * screen_w / snap->w, x1 = (tx + 1) * screen_w / snap->w;
+            uint32_t r = 0, g = 0, b = 0;
+            for (int y = y0; y < y1; y++) {
+                const uint32_t *row = job->src + y * screen_w;
+                for (int x = x0; x < x1; x++) {
+                    r += (row[x] >> 16) & 0xFF;
+                    g += (row[x] >> 8) & 0xFF;
+                    b += row[x] & 0xFF;
+                }
+            }
+            uint32_t n = (x1 - x0) * (y1 - y0);
+            snap->pixels[ty * snap->w + tx] = 0xFF000000 | (r / n) << 16 | (g / n) << 8 | (b / n);
         }
     }
 }
 
-void draw_home_screen(uint32_t *buf) {
-    clear_screen(buf, COLOR_BG);
-    draw_status_bar(buf);
+// Keep a thumbnail of the foreground app for its switcher card. Called when the
+// app stops being the screen: a home gesture starts or the shell moves on.
+void capture_app_snapshot(void) {
+    if (current_app < 0 || current_app >= num_apps) return;
     
-    // App grid
-    int apps_per_row = 3;
-    int grid_width = apps_per_row * ICON_SIZE + (apps_per_row - 1) * MARGIN;
-    int start_x = (screen_w - grid_width) / 2;
-    int start_y = STATUS_HEIGHT + 80;
+    AppSnapshot *snap = &app_snapshots[current_app];
+    if (!snap->pixels) {
+        snap->h = APP_THUMB_HEIGHT;
+        snap->w = APP_THUMB_HEIGHT * screen_w / screen_h;
+        snap->pixels = malloc((size_t)snap->w * snap->h * 4);
+        if (!snap->pixels) return;
+    }
     
-    for (int i = 0; i < APP_COUNT && i < 12; i++) {
-        int row = i / apps_per_row;
-        int col = i % apps_per_row;
-        int x = start_x + col * (ICON_SIZE + MARGIN);
-        int y = start_y + row * (ICON_SIZE + MARGIN * 2);
+    update_app_buffer(NULL);
+    ThumbJob job = {app_buffer, snap};
+    parallel_range(thumb_rows, &job, snap->h);
+    snap->valid = 1;
+}
+
+// Draw the whole shell; primitives skip everything outside clip_rect.
+// Outside gestures this replays shell_lists[shell_list], recorded by draw_invalid_region.
+void render_frame(uint32_t *buf) {
+    if (!is_gesture_frame()) {
+        if (composited_app >= 0) draw_image(buf, app_buffer, screen_w, screen_h, 0, 0);
+        dl_execute(&shell_lists[shell_list], buf);
+        return;
+    }
+    
+    // Render target state as background (don't blur home screen)
+    if (animation_target_state == HOME_SCREEN) {
+        dl_execute(record_home_screen(), buf);
         
-        draw_rounded_rect(buf, x, y, ICON_SIZE, ICON_SIZE, 40, apps[i].color);
+        // Only render scaled app if scale is large enough to be visible
+        if (current_scale > 0.15f) {
+            update_app_buffer(NULL);
+            draw_scaled_window(buf, app_buffer, current_scale, screen_w/2 + lroundf(window_dx), screen_h/2 + lroundf(window_dy));
+        }
+    } else {
+        float blur_amount = (1.0f - current_scale) * 0.5f;
+        draw_blurred_home(buf, blur_amount);
         
-        int text_w = measure_text_width(apps[i].name, SMALL_TEXT);
-        draw_text(buf, apps[i].name, SMALL_TEXT, x + (ICON_SIZE - text_w)/2, y + ICON_SIZE + 20, COLOR_WHITE);
+        update_app_buffer(NULL);
+        draw_scaled_window(buf, app_buffer, current_scale, screen_w/2 + lroundf(window_dx), screen_h/2 + lroundf(window_dy));
     }
-}
-
-void draw_app_screen(uint32_t *buf) {
-    clear_screen(buf, COLOR_BG);
-    draw_status_bar(buf);
     
-    if (current_app >= 0 && current_app < APP_COUNT) {
-        App *app = &apps[current_app];
+    if (touch.is_dragging_indicator) {
+        int bar_w = 240;
+        int bar_x = touch.finger_x - bar_w/2;
+        int bar_y = touch.finger_y - 80; // Position relative to bottom of scaled window
         
-        draw_text_centered(buf, app->name, LARGE_TEXT, STATUS_HEIGHT + 50, COLOR_WHITE);
+        // Keep bar on screen
+        if (bar_x < 20) bar_x = 20;
+        if (bar_x + bar_w > screen_w - 20) bar_x = screen_w - 20 - bar_w;
+        if (bar_y < 0) bar_y = 0;
+        if (bar_y > screen_h - 24) bar_y = screen_h - 24;
         
-        // Call the appropriate app's draw function
-        if (app_draw_functions[current_app]) {
-            app_draw_functions[current_app](buf);
+        draw_rounded_rect(buf, bar_x, bar_y, bar_w, 24, 12, COLOR_BLUE);
+    }
+    
+    if (touch.pressed) {
+        draw_circle_filled(buf, touch.x, touch.y, TOUCH_DOT_RADIUS, COLOR_RED);
+    }
+}
+
+// Try to reserve num_pages screens in yres_virtual and check the driver can pan to them
+static int presenter_try_pages(struct fb_fix_screeninfo *finfo, int num_pages) {
+    struct fb_var_screeninfo v = presenter.vinfo;
+    v.yres_virtual = v.yres * num_pages;
+    v.yoffset = 0;
+    if (ioctl(fb_fd, FBIOPUT_VSCREENINFO, &v) < 0) return 0;
+    if (ioctl(fb_fd, FBIOGET_VSCREENINFO, &v) < 0 || v.yres_virtual < v.yres * num_pages) return 0;
+    if (ioctl(fb_fd, FBIOGET_FSCREENINFO, finfo) < 0) return 0;
+    if ((size_t)finfo->line_length * v.yres * num_pages > finfo->smem_len) return 0;
+    if (ioctl(fb_fd, FBIOPAN_DISPLAY, &v) < 0) return 0;
+    
+    presenter.vinfo = v;
+    return 1;
+}
+
+static uint32_t bitfield_channel(uint32_t c, uint32_t d, const struct fb_bitfield *f) {
+    if (f->length == 0) return 0;
+    if (f->length >= 8) return c << (f->length - 8) << f->offset;
+    c = add_sat8(c, d * (256 >> f->length) / 16);
+    return c >> (8 - f->length) << f->offset;
+}
+
+// Fallback for any other layout the driver describes: scalar, 16, 24 or 32 bpp,
+// dithered like the 565 kernels on channels narrower than 8 bits
+static void to_bitfields(void *dst, const uint32_t *src, int count, int x, int y) {
+    const struct fb_var_screeninfo *v = &presenter.vinfo;
+    int bytes = presenter.bytes_per_pixel;
+    uint8_t *out = dst;
+    for (int i = 0; i < count; i++) {
+        uint32_t p = src[i], d = bayer4[y & 3][(x + i) & 3];
+        uint32_t value = bitfield_channel((p >> 16) & 0xFF, d, &v->red) |
+                         bitfield_channel((p >> 8) & 0xFF, d, &v->green) |
+                         bitfield_channel(p & 0xFF, d, &v->blue);
+        for (int b = 0; b < bytes; b++) out[i * bytes + b] = value >> (8 * b);
+    }
+}
+
+static int bitfields_are(const struct fb_var_screeninfo *v, int bpp, int red, int green, int blue,
+                         int red_len, int green_len, int blue_len) {
+    return v->bits_per_pixel == (unsigned)bpp &&
+           v->red.offset == (unsigned)red && v->red.length == (unsigned)red_len &&
+           v->green.offset == (unsigned)green && v->green.length == (unsigned)green_len &&
+           v->blue.offset == (unsigned)blue && v->blue.length == (unsigned)blue_len;
+}
+
+// Match the panel's pixel layout to a conversion kernel; XRGB8888 needs none
+static void presenter_pick_format(void) {
+    const struct fb_var_screeninfo *v = &presenter.vinfo;
+    presenter.bytes_per_pixel = v->bits_per_pixel / 8;
+    presenter.convert = NULL;
+    
+    // Drivers that leave the bitfields empty at 32 bpp are taken to be XRGB8888
+    if (bitfields_are(v, 32, 16, 8, 0, 8, 8, 8) || (v->bits_per_pixel == 32 && v->red.length == 0)) {
+        presenter.format = "XRGB8888";
+    } else if (bitfields_are(v, 32, 0, 8, 16, 8, 8, 8)) {
+        presenter.format = "XBGR8888";
+        presenter.convert = pixel_kernels.to_xbgr8888;
+    } else if (bitfields_are(v, 16, 11, 5, 0, 5, 6, 5)) {
+        presenter.format = "RGB565";
+        presenter.convert = pixel_kernels.to_rgb565;
+    } else if (bitfields_are(v, 16, 0, 5, 11, 5, 6, 5)) {
+        presenter.format = "BGR565";
+        presenter.convert = pixel_kernels.to_bgr565;
+    } else if (v->bits_per_pixel == 16 || v->bits_per_pixel == 24 || v->bits_per_pixel == 32) {
+        presenter.format = "bitfields";
+        presenter.convert = to_bitfields;
+    } else {
+        fprintf(stderr, "Unsupported framebuffer format: %u bpp\n", v->bits_per_pixel);
+        exit(1);
+    }
+    printf("🎨 Panel format: %s, %u bpp (r%u:%u g%u:%u b%u:%u)%s\n", presenter.format, v->bits_per_pixel,
+           v->red.offset, v->red.length, v->green.offset, v->green.length, v->blue.offset, v->blue.length,
+           presenter.convert ? ", converted at present" : "");
+}
+
+void init_presenter(void) {
+    struct fb_fix_screeninfo finfo;
+    ioctl(fb_fd, FBIOGET_VSCREENINFO, &presenter.vinfo);
+    ioctl(fb_fd, FBIOGET_FSCREENINFO, &finfo);
+    
+    screen_w = presenter.vinfo.xres;
+    screen_h = presenter.vinfo.yres;
+    presenter_pick_format();
+    
+    // Native pages are drawn into directly, so they need the same layout as our
+    // surfaces; converted pages are only ever written by present_rect
+    presenter.mode = PRESENT_COPY;
+    presenter.num_pages = 1;
+    if (presenter.convert || finfo.line_length == (unsigned)screen_w * 4) {
+        for (int pages = MAX_FB_PAGES; pages >= 2; pages--) {
+            if (presenter_try_pages(&finfo, pages)) {
+                presenter.mode = PRESENT_FLIP;
+                presenter.num_pages = pages;
+                break;
+            }
         }
     }
     
-    // Draw home indicator on app screen
-    if (current_scale >= 0.98f && !touch.is_dragging_indicator) {
-        draw_rounded_rect(buf, screen_w/2 - 100, screen_h - 80, 200, 24, 12, COLOR_WHITE);
+    stride = finfo.line_length;
+    presenter.map_size = (size_t)stride * screen_h * presenter.num_pages;
+    framebuffer = mmap(0, presenter.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fb_fd, 0);
+    if (framebuffer == MAP_FAILED) { perror("Framebuffer mmap failed"); exit(1); }
+    
+    for (int i = 0; i < presenter.num_pages; i++) {
+        presenter.pages[i] = (uint8_t *)framebuffer + (size_t)i * stride * screen_h;
+        presenter.page_damage[i].count = 0;
+    }
+    presenter.front = 0;
+    
+    if (presenter.mode == PRESENT_FLIP) {
+        uint32_t arg = 0;
+        presenter.can_wait_vsync = ioctl(fb_fd, FBIO_WAITFORVSYNC, &arg) == 0;
+        if (presenter.convert) {
+            backbuffer = malloc(screen_w * screen_h * 4);
+            if (!backbuffer) { perror("Backbuffer allocation failed"); exit(1); }
+        } else {
+            backbuffer = (uint32_t *)presenter.pages[1];
+        }
+        printf("🖥️ Page flipping with %d pages%s\n", presenter.num_pages,
+               presenter.can_wait_vsync ? ", vsync" : "");
+    } else {
+        backbuffer = malloc(screen_w * screen_h * 4);
+        if (!backbuffer) { perror("Backbuffer allocation failed"); exit(1); }
+        printf("🖥️ Copy presentation, %d byte stride\n", stride);
     }
 }
 
-void draw_app_switcher(uint32_t *buf) {
-    clear_screen(buf, COLOR_BG);
-    draw_status_bar(buf);
+// Headless backend: a heap framebuffer of any size, presented with the copy path
+void init_memory_presenter(int width, int height) {
+    screen_w = width;
+    screen_h = height;
+    stride = width * 4;
     
-    if (num_open_apps == 0) {
-        draw_text_centered(buf, "No open apps", MEDIUM_TEXT, screen_h/2, COLOR_GRAY);
-        draw_rounded_rect(buf, screen_w/2 - 100, screen_h - 80, 200, 24, 12, COLOR_WHITE);
+    presenter.mode = PRESENT_MEMORY;
+    presenter.format = "XRGB8888";
+    presenter.bytes_per_pixel = 4;
+    presenter.convert = NULL;
+    presenter.num_pages = 1;
+    presenter.front = 0;
+    presenter.map_size = (size_t)stride * height;
+    presenter.can_wait_vsync = 0;
+    
+    framebuffer = calloc(1, presenter.map_size);
+    backbuffer = malloc(presenter.map_size);
+    if (!framebuffer || !backbuffer) { perror("Headless buffer allocation failed"); exit(1); }
+    presenter.pages[0] = (uint8_t *)framebuffer;
+    printf("🖥️ Headless %dx%d\n", width, height);
+}
+
+// Pick the page to draw into and turn the frame's damage into that page's damage.
+// Every page accumulates damage until it is drawn, so a page that was last shown
+// a few frames ago is brought fully up to date. Converted pages are brought up
+// to date from the backbuffer in present_frame instead.
+void presenter_begin_frame(void) {
+    if (presenter.mode != PRESENT_FLIP || presenter.convert) return;
+    
+    for (int p = 0; p < presenter.num_pages; p++) {
+        for (int i = 0; i < invalid_region.count; i++) {
+            Rect r = invalid_region.rects[i];
+            damage_add(&presenter.page_damage[p], r.x, r.y, r.w, r.h);
+        }
+    }
+    
+    int back = (presenter.front + 1) % presenter.num_pages;
+    invalid_region = presenter.page_damage[back];
+    presenter.page_damage[back].count = 0;
+    backbuffer = (uint32_t *)presenter.pages[back];
+}
+
+// Write one rect of the backbuffer into a framebuffer page in the panel's format
+static void present_rect(uint8_t *page, Rect r) {
+    for (int y = r.y; y < r.y + r.h; y++) {
+        uint8_t *dst = page + (size_t)y * stride + r.x * presenter.bytes_per_pixel;
+        const uint32_t *src = backbuffer + y * screen_w + r.x;
+        if (presenter.convert) {
+            presenter.convert(dst, src, r.w, r.x, y);
+        } else {
+            pixel_kernels.copy((uint32_t *)dst, src, r.w);
+        }
+    }
+}
+
+void present_frame(void) {
+    if (presenter.mode != PRESENT_FLIP) {
+        present_damage();
         return;
     }
     
-    draw_text_centered(buf, "Open Apps", MEDIUM_TEXT, STATUS_HEIGHT + 20, COLOR_WHITE);
+    int back = (presenter.front + 1) % presenter.num_pages;
+    if (presenter.convert) {
+        // Every page owes this frame's damage; convert what the back page owes
+        for (int p = 0; p < presenter.num_pages; p++) {
+            for (int i = 0; i < drawn_region.count; i++) {
+                Rect r = drawn_region.rects[i];
+                damage_add(&presenter.page_damage[p], r.x, r.y, r.w, r.h);
+            }
+        }
+        for (int i = 0; i < presenter.page_damage[back].count; i++) {
+            present_rect(presenter.pages[back], presenter.page_damage[back].rects[i]);
+        }
+        presenter.page_damage[back].count = 0;
+    }
     
-    // Calculate grid layout
-    int cards_per_row = 2;
-    int card_w = 320;
-    int card_h = 200;
-    int margin_x = 60;
-    int margin_y = 40;
+    presenter.vinfo.yoffset = back * screen_h;
+    if (ioctl(fb_fd, FBIOPAN_DISPLAY, &presenter.vinfo) < 0) {
+        perror("FBIOPAN_DISPLAY failed");
+    }
+    if (presenter.can_wait_vsync) {
+        uint32_t arg = 0;
+        ioctl(fb_fd, FBIO_WAITFORVSYNC, &arg);
+    }
+    presenter.front = back;
+    drawn_region.count = 0;
+}
+
+// Copy only the merged rects written this frame out to the framebuffer,
+// converting them on the way if the panel isn't XRGB8888
+void present_damage(void) {
+    for (int i = 0; i < drawn_region.count; i++) {
+        present_rect(presenter.pages[0], drawn_region.rects[i]);
+    }
+    drawn_region.count = 0;
+}
+
+// Blank the visible page and release the framebuffer
+void shutdown_presenter(void) {
+    if (!framebuffer) return;
     
-    int grid_width = cards_per_row * card_w + (cards_per_row - 1) * margin_x;
-    int start_x = (screen_w - grid_width) / 2;
-    int start_y = STATUS_HEIGHT + 100;
+    if (presenter.mode != PRESENT_MEMORY) {
+        uint8_t *visible = presenter.pages[presenter.front];
+        if (presenter.convert) {
+            for (int y = 0; y < screen_h; y++) {
+                pixel_kernels.fill(backbuffer + y * screen_w, COLOR_BG, screen_w);
+            }
+            present_rect(visible, (Rect){0, 0, screen_w, screen_h});
+        } else {
+            for (int y = 0; y < screen_h; y++) {
+                pixel_kernels.fill((uint32_t *)(visible + (size_t)y * stride), COLOR_BG, screen_w);
+            }
+        }
+    }
     
-    // Draw open app cards
-    int card_index = 0;
-    for (int i = 0; i < APP_COUNT; i++) {
-        if (!open_apps[i]) continue;
-        
-        int row = card_index / cards_per_row;
-        int col = card_index % cards_per_row;
-        int x = start_x + col * (card_w + margin_x);
-        int y = start_y + row * (card_h + margin_y);
-        
-        // Card background
-        draw_rounded_rect(buf, x, y, card_w, card_h, 20, COLOR_GRAY);
-        draw_rounded_rect(buf, x + 10, y + 10, card_w - 20, card_h - 20, 15, apps[i].color);
-        
-        // App icon area
-        int icon_x = x + (card_w - 60) / 2;
-        int icon_y = y + 40;
-        draw_rounded_rect(buf, icon_x, icon_y, 60, 60, 15, COLOR_WHITE);
-        
-        // App name
-        int text_w = measure_text_width(apps[i].name, SMALL_TEXT);
-        draw_text(buf, apps[i].name, SMALL_TEXT, x + (card_w - text_w)/2, y + card_h - 40, COLOR_WHITE);
-        
-        card_index++;
+    if (presenter.mode == PRESENT_FLIP) {
+        presenter.vinfo.yoffset = 0;
+        ioctl(fb_fd, FBIOPAN_DISPLAY, &presenter.vinfo);
+    }
+    if (backbuffer && (presenter.mode != PRESENT_FLIP || presenter.convert)) {
+        free(backbuffer);
+    }
+    backbuffer = NULL;
+    if (presenter.mode == PRESENT_MEMORY) {
+        free(framebuffer);
+    } else {
+        munmap(framebuffer, presenter.map_size);
+    }
+    framebuffer = NULL;
+}
+
+#if PERF_STATS
+static void request_perf_dump(int sig) {
+    perf_dump_requested = 1;
+}
+
+static void request_perf_hud_toggle(int sig) {
+    perf_hud_toggle_requested = 1;
+}
+#endif
+
+// Bottom-left corner, clear of the home indicator
+static Rect perf_hud_rect(void) {
+    return (Rect){20, screen_h - PERF_HUD_H - 140, PERF_HUD_W, PERF_HUD_H};
+}
+
+// Redraw everything invalidated since the last frame and show it
+// Returns 1 if a frame was drawn.
+int draw_invalid_region(void) {
+    uint64_t perf_start = perf_begin();
+    uint64_t frame_start_us = input_clock_us();
+    predict_drag();
+    if (is_gesture_frame()) {
+        // Gesture frames composite from app_buffer, so they always redraw in full
+        invalidate_screen();
+        shell_lists[shell_list].valid = 0;
+        composited_app = -1;
+    } else if (current_state == APP_SCREEN && current_app >= 0) {
+        // The app screen is kept in app_buffer, the app's surface, and copied out
+        // under the touch dot. Only areas that changed in either are redrawn.
+        if (composited_app != current_app) {
+            invalidate_screen();
+            composited_app = current_app;
+        }
+        update_app_buffer(&invalid_region);
+        DisplayList *next = &shell_lists[shell_list ^ 1];
+        dl_begin(next);
+        if (touch.pressed) draw_circle_filled(NULL, touch.x, touch.y, TOUCH_DOT_RADIUS, COLOR_RED);
+        dl_end();
+        dl_diff(&shell_lists[shell_list], next, &invalid_region);
+        shell_list ^= 1;
+    } else {
+        composited_app = -1;
+        // Record the screen plus touch dot and damage only what changed since it was shown
+        DisplayList *next = &shell_lists[shell_list ^ 1];
+        dl_begin(next);
+        draw_screen(NULL, current_state);
+        if (touch.pressed) draw_circle_filled(NULL, touch.x, touch.y, TOUCH_DOT_RADIUS, COLOR_RED);
+        dl_end();
+        dl_diff(&shell_lists[shell_list], next, &invalid_region);
+        shell_list ^= 1;
+    }
+    if (invalid_region.count == 0) {
+        if (perf_active()) perf.unpresented_input_us = 0;     // Input that changed nothing is never shown
+        return 0;
+    }
+    
+    // The HUD refreshes whenever something else is drawn, never on its own
+    int hud = perf_active() && perf.hud;
+    Rect hud_rect = perf_hud_rect();
+    if (hud) invalidate_rect(hud_rect.x, hud_rect.y, hud_rect.w, hud_rect.h);
+    
+    presenter_begin_frame();
+    drawn_region.count = 0;
+    for (int i = 0; i < invalid_region.count; i++) {
+        clip_rect = invalid_region.rects[i];
+        render_frame(backbuffer);
+    }
+    if (hud) {
+        clip_rect = hud_rect;
+        draw_perf_hud(backbuffer);
+    }
+    clip_rect = (Rect){0, 0, screen_w, screen_h};
+    invalid_region.count = 0;
+    perf_end(PERF_RENDER, perf_start);
+    
+    perf_start = perf_begin();
+    present_frame();
+    perf_end(PERF_PRESENT, perf_start);
+    
+    uint64_t presented_us = input_clock_us();
+    present_lead_us = (present_lead_us * 7 + (presented_us - frame_start_us)) / 8;
+    if (perf_active() && perf.unpresented_input_us) {
+        int64_t latency = (int64_t)(presented_us - perf.unpresented_input_us);
+        perf.stage_ns[PERF_LATENCY] = latency > 0 ? latency * 1000 : 1;
+        perf.unpresented_input_us = 0;
+    }
+    return 1;
+}
+
+static int perf_bucket(uint32_t us) {
+    if (us < PERF_SUB_BUCKETS) return us;
+    int exponent = 31 - __builtin_clz(us);
+    int bucket = (exponent - 3) * PERF_SUB_BUCKETS + ((us >> (exponent - 4)) & (PERF_SUB_BUCKETS - 1));
+    return bucket < PERF_BUCKETS ? bucket : PERF_BUCKETS - 1;
+}
+
+// Upper edge of a bucket in microseconds
+static uint32_t perf_bucket_limit(int bucket) {
+    if (bucket < PERF_SUB_BUCKETS) return bucket;
+    int exponent = bucket / PERF_SUB_BUCKETS + 3;
+    int sub = bucket % PERF_SUB_BUCKETS;
+    return ((uint32_t)(PERF_SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+}
+
+static void perf_record(PerfStage stage, uint64_t ns) {
+    uint32_t us = ns / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(ns / 1000);
+    PerfHistogram *hist = &perf.windows[perf.current][stage];
+    hist->counts[perf_bucket(us)]++;
+    hist->total++;
+    if (us > hist->max_us) hist->max_us = us;
+}
+
+void perf_begin_frame(void) {
+    if (!perf_active()) return;
+    memset(perf.stage_ns, 0, sizeof(perf.stage_ns));
+    perf.frame_start_ns = perf_now_ns();
+}
+
+// Fold this iteration's stage times into the histograms; idle wakeups that
+// drew nothing only count their input stages
+void perf_end_frame(int drew) {
+    if (!perf_active()) return;
+    
+    uint64_t now = get_time_ms();
+    if (now - perf.window_start_ms >= PERF_WINDOW_MS) {
+        perf.current ^= 1;
+        memset(perf.windows[perf.current], 0, sizeof(perf.windows[perf.current]));
+        perf.window_start_ms = now;
+    }
+    
+    for (int s = 0; s < PERF_FRAME; s++) {
+        if (perf.stage_ns[s]) perf_record(s, perf.stage_ns[s]);
     }
+    if (!drew) return;
+    
+    uint64_t frame_ns = perf_now_ns() - perf.frame_start_ns;
+    perf_record(PERF_FRAME, frame_ns);
+    perf.frames++;
+    if (frame_ns > FRAME_INTERVAL_NS) perf.missed_deadlines++;
     
-    draw_text_centered(buf, "Tap to open • Swipe up on card to close", SMALL_TEXT, screen_h - 150, COLOR_LIGHT_GRAY);
-    draw_rounded_rect(buf, screen_w/2 - 100, screen_h - 80, 200, 24, 12, COLOR_WHITE);
+    perf.history_us[perf.history_pos] = frame_ns / 1000;
+    perf.history_pos = (perf.history_pos + 1) % PERF_HUD_SAMPLES;
 }
 
-void update_animations(void) {
-    if (is_animating) {
-        float diff = target_scale - current_scale;
-        if (fabs(diff) < 0.01f || (target_scale == 0.0f && current_scale < 0.05f)) {
-            current_scale = target_scale;
-            is_animating = 0;
-            
-            if (animation_target_state != current_state) {
-                current_state = animation_target_state;
-                if (current_state == HOME_SCREEN) {
-                    current_scale = 1.0f;
-                    target_scale = 1.0f;
-                }
-                printf("✅ Animation complete → %s\n", 
-                    current_state == HOME_SCREEN ? "Home" : 
-                    current_state == APP_SWITCHER ? "App Switcher" : "App");
-            }
-        } else {
-            current_scale += diff * 0.3f;
-        }
+// Merge both windows and return the value at the given fraction of samples
+static uint32_t perf_percentile(PerfStage stage, double fraction, uint32_t total) {
+    uint32_t rank = (uint32_t)(fraction * total);
+    uint32_t seen = 0;
+    for (int b = 0; b < PERF_BUCKETS; b++) {
+        seen += perf.windows[0][stage].counts[b] + perf.windows[1][stage].counts[b];
+        if (seen > rank) return perf_bucket_limit(b);
     }
+    return 0;
 }
 
-void handle_touch_input(void) {
-    // Handle touch press - start gesture tracking
-    if (touch.pressed && !touch.last_pressed) {
-        touch.touch_start_time = get_time_ms();
-        touch.start_x = touch.x;
-        touch.start_y = touch.y;
-        touch.swipe_detected = 0;
-        touch.action_taken = 0;
-        
-        // Start home gesture tracking only from app screens
-        if ((current_state == APP_SCREEN || current_state == APP_SWITCHER) && 
-            is_touching_home_indicator(touch.x, touch.y)) {
-            touch.is_dragging_indicator = 1;
-            touch.drag_start_y = touch.y;
-            touch.finger_x = touch.x;
-            touch.finger_y = touch.y;
-            printf("🎯 Started home gesture\n");
+void perf_dump(FILE *out) {
+    static const char *names[PERF_STAGE_COUNT] = {
+        "input", "touch", "animate", "render", "  blur", "  scale", "present", "latency", "frame"
+    };
+    
+    fprintf(out, "📊 Frame stats, last %d-%ds: %llu frames, %llu missed deadlines (total)\n",
+            PERF_WINDOW_MS / 1000, PERF_WINDOW_MS / 500,
+            (unsigned long long)perf.frames, (unsigned long long)perf.missed_deadlines);
+    fprintf(out, "   input ring: %llu samples, %llu dropped, peak depth %u\n",
+            (unsigned long long)__atomic_load_n(&input_ring.pushed, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&input_ring.dropped, __ATOMIC_RELAXED),
+            __atomic_load_n(&input_ring.high_water, __ATOMIC_RELAXED));
+    fprintf(out, "   %-8s %8s %9s %9s %9s\n", "stage", "count", "p50 ms", "p99 ms", "max ms");
+    for (int s = 0; s < PERF_STAGE_COUNT; s++) {
+        uint32_t total = perf.windows[0][s].total + perf.windows[1][s].total;
+        if (total == 0) continue;
+        uint32_t max_us = perf.windows[0][s].max_us > perf.windows[1][s].max_us ?
+                          perf.windows[0][s].max_us : perf.windows[1][s].max_us;
+        uint32_t p50 = perf_percentile(s, 0.5, total), p99 = perf_percentile(s, 0.99, total);
+        fprintf(out, "   %-8s %8u %9.2f %9.2f %9.2f\n", names[s], total,
+                (p50 < max_us ? p50 : max_us) / 1000.0, (p99 < max_us ? p99 : max_us) / 1000.0,
+                max_us / 1000.0);
+    }
+    surface_pool_print_stats(out);
+    fflush(out);
+}
+
+// Act on SIGUSR1 (dump stats) and SIGUSR2 (toggle the HUD) from the main loop
+void perf_handle_requests(void) {
+    if (perf_hud_toggle_requested) {
+        perf_hud_toggle_requested = 0;
+        perf.hud = !perf.hud;
+        if (perf.hud) perf.enabled = 1;
+        Rect hud_rect = perf_hud_rect();
+        invalidate_rect(hud_rect.x, hud_rect.y, hud_rect.w, hud_rect.h);
+        printf("📊 Performance HUD %s\n", perf.hud ? "on" : "off");
+    }
+    if (perf_dump_requested) {
+        perf_dump_requested = 0;
+        FILE *out = perf.stats_path ? fopen(perf.stats_path, "a") : stdout;
+        if (!out) {
+            perror(perf.stats_path);
             return;
         }
+        perf_dump(out);
+        if (out != stdout) fclose(out);
+    }
+}
+
+// Frame-time graph: one bar per frame, the line marks the frame deadline
+void draw_perf_hud(uint32_t *buf) {
+    Rect hud = perf_hud_rect();
+    int x = hud.x, y = hud.y;
+    int graph_top = y + PERF_HUD_TEXT + 8;
+    int graph_h = PERF_HUD_H - (graph_top - y);
+    
+    int dx = hud.x, dy = hud.y, dw = hud.w, dh = hud.h;
+    if (!clip_rect_to_clip(&dx, &dy, &dw, &dh)) return;
+    damage_record(buf, dx, dy, dw, dh);
+    for (int row = dy; row < dy + dh; row++) {
+        pixel_kernels.darken(buf + row * screen_w + dx, 160, dw);
     }
     
-    // Handle dragging - update gesture progress  
-    if (touch.pressed && touch.is_dragging_indicator) {
-        int drag_distance = touch.drag_start_y - touch.y;
-        if (drag_distance >= 0) {
-            current_scale = calculate_scale_from_drag(drag_distance);
-            touch.finger_x = touch.x;
-            touch.finger_y = touch.y;
+    for (int i = 0; i < PERF_HUD_SAMPLES; i++) {
+        uint32_t us = perf.history_us[(perf.history_pos + i) % PERF_HUD_SAMPLES];
+        if (us == 0) continue;
+        int bar_h = us >= PERF_HUD_RANGE_US ? graph_h : (int)((uint64_t)us * graph_h / PERF_HUD_RANGE_US);
+        if (bar_h < 1) bar_h = 1;
+        uint32_t color = us * 1000 <= FRAME_INTERVAL_NS ? COLOR_GREEN :
+                         us * 1000 <= 2 * FRAME_INTERVAL_NS ? COLOR_ORANGE : COLOR_RED;
+        draw_rect(buf, x + i * 2, graph_top + graph_h - bar_h, 2, bar_h, color);
+    }
+    int deadline_y = graph_top + graph_h - (int)((uint64_t)FRAME_INTERVAL_NS / 1000 * graph_h / PERF_HUD_RANGE_US);
+    draw_rect(buf, x, deadline_y, PERF_HUD_W, 1, COLOR_WHITE);
+    
+    uint32_t total = perf.windows[0][PERF_FRAME].total + perf.windows[1][PERF_FRAME].total;
+    if (total > 0) {
+        char label[64];
+        snprintf(label, sizeof(label), "p50 %.1f  p99 %.1f ms",
+                 perf_percentile(PERF_FRAME, 0.5, total) / 1000.0, perf_percentile(PERF_FRAME, 0.99, total) / 1000.0);
+        draw_text(buf, label, PERF_HUD_TEXT, x + 6, y + 4, COLOR_WHITE);
+    }
+}
+
+void cleanup_and_exit(int sig) {
+    if (perf_active()) perf_dump(stdout);
+    shutdown_presenter();
+    if (app_buffer) free(app_buffer);
+    if (fb_fd > 0) close(fb_fd);
+    glyph_cache_print_stats();
+    text_layout_print_stats();
+    surface_pool_print_stats(stdout);
+    input_ring_print_stats();
+    if (input_epoll_fd >= 0) close(input_epoll_fd);
+    if (input_inotify_fd >= 0) close(input_inotify_fd);
+    for (int i = 0; i < MAX_TOUCH_DEVICES; i++) {
+        if (touch_devices[i].fd >= 0) close(touch_devices[i].fd);
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (frame_timer_fd >= 0) close(frame_timer_fd);
+    if (wake_fd >= 0) close(wake_fd);
+    exit(0);
+}
+
+// Snapshot sequence for --snapshot, laid out for HEADLESS_DEFAULT_W x HEADLESS_DEFAULT_H.
+// It opens the first app, which must be the Test module built from test.c into
+// apps/Test.so (check_snapshots.sh builds it).
+static const char snapshot_script[] =
+    "capture home\n"
+    "tap 280 320\n"
+    "wait 100\n"
+    "expect app\n"
+    "capture app\n"
+    "down 540 1880\n"
+    "move 540 1300\n"
+    "capture gesture_drag\n"
+    "up\n"
+    "wait 50\n"
+    "capture gesture_release\n"
+    "wait 1000\n"
+    "state switcher\n"
+    "capture switcher\n";
+
+static int write_ppm(const char *path, const uint32_t *pixels, int width, int height) {
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return 0; }
+    
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    uint8_t *row = malloc(width * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t c = pixels[y * width + x];
+            row[x * 3] = (c >> 16) & 0xFF;
+            row[x * 3 + 1] = (c >> 8) & 0xFF;
+            row[x * 3 + 2] = c & 0xFF;
         }
-        return;
+        fwrite(row, 3, width, f);
     }
+    free(row);
+    return fclose(f) == 0;
+}
+
+// Load a binary PPM written by write_ppm, returns NULL if missing or malformed
+static uint32_t *read_ppm(const char *path, int *width, int *height) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
     
-    // Handle touch release - complete gestures
-    if (!touch.pressed && touch.last_pressed) {
-        uint64_t touch_duration = get_time_ms() - touch.touch_start_time;
-        
-        // Complete home gesture if in progress
-        if (touch.is_dragging_indicator) {
-            int final_drag = touch.drag_start_y - touch.y;
-            float threshold = screen_h * 0.15f;
-            
-            int quick_swipe = is_quick_swipe_up(touch.start_x, touch.start_y, 
-                                              touch.x, touch.y, touch_duration);
-            
-            if (final_drag > threshold || quick_swipe) {
-                AppState target = get_home_gesture_target(current_state);
-                
-                if (target != current_state) {
-                    printf("🏠 Home gesture → %s\n", 
-                           target == HOME_SCREEN ? "home" : target == APP_SWITCHER ? "app switcher" : "unknown");
-                    animation_target_state = target;
-                    target_scale = 0.0f;
-                    is_animating = 1;
-                } else {
-                    printf("🏠 Home gesture ignored (same state)\n");
-                    target_scale = 1.0f;
-                    is_animating = 1;
-                }
-            } else {
-                printf("↩️ Home gesture cancelled\n");
-                animation_target_state = current_state;
-                target_scale = 1.0f;
-                is_animating = 1;
-            }
-            
-            touch.is_dragging_indicator = 0;
-            return;
+    int maxval;
+    if (fscanf(f, "P6 %d %d %d", width, height, &maxval) != 3 || maxval != 255 ||
+        *width <= 0 || *height <= 0 || fgetc(f) == EOF) {
+        fclose(f);
+        return NULL;
+    }
+    
+    uint32_t *pixels = malloc((size_t)*width * *height * 4);
+    uint8_t rgb[3];
+    for (int i = 0; i < *width * *height; i++) {
+        if (fread(rgb, 1, 3, f) != 3) {
+            free(pixels);
+            fclose(f);
+            return NULL;
         }
-        
-        // Quick swipe detection for instant gestures from app screens
-        if ((current_state == APP_SCREEN || current_state == APP_SWITCHER) &&
-            is_touching_home_indicator(touch.start_x, touch.start_y)) {
-            int quick_swipe = is_quick_swipe_up(touch.start_x, touch.start_y, 
-                                              touch.x, touch.y, touch_duration);
-            if (quick_swipe) {
-                AppState target = get_home_gesture_target(current_state);
-                if (target != current_state) {
-                    printf("🚀 Quick home swipe → %s\n", 
-                           target == HOME_SCREEN ? "home" : target == APP_SWITCHER ? "app switcher" : "unknown");
-                    animation_target_state = target;
-                    target_scale = 0.0f;
-                    is_animating = 1;
-                    current_scale = 0.8f;
-                }
-                return;
-            }
+        pixels[i] = 0xFF000000 | (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+    }
+    fclose(f);
+    return pixels;
+}
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Redraw the current state in full SNAPSHOT_TIMING_RUNS times, returning the
+// average time and storing the fastest in best
+static double time_full_redraws(double *best) {
+    double total = 0;
+    for (int i = 0; i < SNAPSHOT_TIMING_RUNS; i++) {
+        invalidate_screen();
+        double start = monotonic_ms();
+        draw_invalid_region();
+        double elapsed = monotonic_ms() - start;
+        total += elapsed;
+        if (i == 0 || elapsed < *best) *best = elapsed;
+    }
+    perf_begin_frame();         // Keep the timing redraws out of the stage histograms
+    return total / SNAPSHOT_TIMING_RUNS;
+}
+
+// Time full redraws of the current state with 1, 2, 4 ... N render threads and
+// check that every thread count draws exactly what one thread does.
+// Returns 0 on success.
+static int bench_capture(const char *name) {
+    size_t bytes = (size_t)screen_w * screen_h * 4;
+    uint32_t *reference = malloc(bytes);
+    if (!reference) return 1;
+    
+    printf("⏱️  %-16s", name);
+    double base = 0, best = 0;
+    int failed = 0;
+    for (int n = 1; ; n = n * 2 < render_pool.num_threads ? n * 2 : render_pool.num_threads) {
+        render_pool_set_active(n);
+        time_full_redraws(&best);
+        if (n == 1) {
+            base = best;
+            memcpy(reference, framebuffer, bytes);
+        } else if (memcmp(reference, framebuffer, bytes) != 0) {
+            failed = 1;
         }
+        printf("  %dT %6.2f ms %4.2fx", n, best, base / best);
+        if (n == render_pool.num_threads) break;
     }
+    render_pool_set_active(render_pool.num_threads);
+    printf("  %s\n", failed ? "FAILED: output differs" : "identical");
+    free(reference);
+    return failed;
+}
+
+// Time full redraws of the current state, then save or check what is on screen.
+// Returns 0 on success.
+static int snapshot_capture(const char *name, const char *out_dir, int compare) {
+    double best = 0;
+    double average = time_full_redraws(&best);
     
-    // Button handling (only when not in gesture mode and not already acted)
-    if (!touch.pressed || touch.action_taken || touch.is_dragging_indicator) return;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.ppm", out_dir, name);
     
-    if (current_state == HOME_SCREEN) {
-        int apps_per_row = 3;
-        int grid_width = apps_per_row * ICON_SIZE + (apps_per_row - 1) * MARGIN;
-        int start_x = (screen_w - grid_width) / 2;
-        int start_y = STATUS_HEIGHT + 80;
-        
-        for (int i = 0; i < APP_COUNT && i < 12; i++) {
-            int row = i / apps_per_row;
-            int col = i % apps_per_row;
-            int icon_x = start_x + col * (ICON_SIZE + MARGIN);
-            int icon_y = start_y + row * (ICON_SIZE + MARGIN * 2);
-            
-            if (touch.x >= (icon_x - 50) && touch.x < (icon_x + ICON_SIZE + 50) &&
-                touch.y >= (icon_y - 50) && touch.y < (icon_y + ICON_SIZE + 50)) {
-                touch.action_taken = 1;
-                current_app = i;
-                add_open_app(i);
-                current_state = APP_SCREEN;
-                animation_target_state = APP_SCREEN;
-                printf("🚀 Launched: %s\n", apps[i].name);
-                return;
-            }
+    const char *result = "written";
+    int failed = 0;
+    int golden_w, golden_h;
+    uint32_t *golden = compare ? read_ppm(path, &golden_w, &golden_h) : NULL;
+    
+    if (compare && !golden) {
+        // A check with nothing to check against must not pass
+        result = "FAILED: no golden, record one with --update";
+        failed = 1;
+    } else if (!golden) {
+        if (!write_ppm(path, framebuffer, screen_w, screen_h)) return 1;
+    } else if (golden_w != screen_w || golden_h != screen_h) {
+        result = "FAILED: golden size differs";
+        failed = 1;
+    } else {
+        int diff = 0;
+        for (int i = 0; i < screen_w * screen_h; i++) {
+            if ((golden[i] ^ framebuffer[i]) & 0xFFFFFF) diff++;
         }
-    } else if (current_state == APP_SWITCHER) {
-        if (num_open_apps == 0) return;
-        
-        int cards_per_row = 2;
-        int card_w = 320;
-        int card_h = 200;
-        int margin_x = 60;
-        int margin_y = 40;
-        
-        int grid_width = cards_per_row * card_w + (cards_per_row - 1) * margin_x;
-        int start_x = (screen_w - grid_width) / 2;
-        int start_y = STATUS_HEIGHT + 100;
-        
-        int card_index = 0;
-        for (int i = 0; i < APP_COUNT; i++) {
-            if (!open_apps[i]) continue;
-            
-            int row = card_index / cards_per_row;
-            int col = card_index % cards_per_row;
-            int x = start_x + col * (card_w + margin_x);
-            int y = start_y + row * (card_h + margin_y);
-            
-            if (touch.x >= x && touch.x < (x + card_w) &&
-                touch.y >= y && touch.y < (y + card_h)) {
-                touch.action_taken = 1;
-                
-                int swipe_dy = touch.start_y - touch.y;
-                if (swipe_dy > 100 && (get_time_ms() - touch.touch_start_time) < 500) {
-                    remove_open_app(i);
-                    printf("❌ Closed app: %s\n", apps[i].name);
-                    
-                    if (num_open_apps == 0) {
-                        current_state = HOME_SCREEN;
-                        animation_target_state = HOME_SCREEN;
-                    }
-                    return;
-                } else {
-                    current_app = i;
-                    current_state = APP_SCREEN;
-                    animation_target_state = APP_SCREEN;
-                    printf("🚀 Opened app: %s\n", apps[i].name);
-                    return;
-                }
-            }
+        if (diff == 0) {
+            result = "matches";
+        } else {
+            static char message[64];
+            snprintf(message, sizeof(message), "FAILED: %d pixels differ", diff);
+            result = message;
+            failed = 1;
             
-            card_index++;
-        }
-    } else if (current_state == APP_SCREEN && current_app >= 0) {
-        // Handle app-specific touch input
-        if (current_app == 0) { // Test app
-            handle_test_app_touch(touch.x, touch.y, touch.pressed, touch.last_pressed);
+            snprintf(path, sizeof(path), "%s/%s.actual.ppm", out_dir, name);
+            write_ppm(path, framebuffer, screen_w, screen_h);
         }
-        // Add other app touch handlers here as needed
     }
+    free(golden);
+    
+    printf("📸 %-16s %7.2f ms avg %7.2f ms min  %s\n",
+           name, average, best, result);
+    return failed;
 }
 
-void init_touch_devices(void) {
-    for (int i = 0; i < 16; i++) {
-        char path[64];
-        snprintf(path, sizeof(path), "/dev/input/event%d", i);
-        int fd = open(path, O_RDONLY | O_NONBLOCK);
-        if (fd < 0) continue;
-        
-        struct input_absinfo abs_x, abs_y;
-        if (ioctl(fd, EVIOCGABS(ABS_X), &abs_x) < 0 || 
-            ioctl(fd, EVIOCGABS(ABS_Y), &abs_y) < 0) {
-            close(fd);
-            continue;
-        }
-        
-        touch_devices[num_touch_devices++] = (TouchDevice){
-            fd, abs_x.minimum, abs_x.maximum, abs_y.minimum, abs_y.maximum
-        };
+static const char *script_state_name(AppState state) {
+    return state == HOME_SCREEN ? "home" : state == APP_SWITCHER ? "switcher" : "app";
+}
+
+// Jump straight to a shell state: "home", "switcher" or "app <index>"
+static int script_set_state(const char *state, int app) {
+    if (strcmp(state, "home") == 0) {
+        app_suspend();
+        current_state = HOME_SCREEN;
+    } else if (strcmp(state, "switcher") == 0) {
+        app_suspend();
+        current_state = APP_SWITCHER;
+    } else if (strcmp(state, "app") != 0 || app < 0 || app >= num_apps || !show_app(app)) {
+        return 0;
     }
+    animation_target_state = current_state;
+    reset_window();
+    return 1;
+}
+
+// One main-loop iteration's worth of drawing after a scripted event
+static void script_frame(void) {
+    run_completed_jobs();
+    perf_end_frame(draw_invalid_region());
 }
 
-void read_touch_events(void) {
-    struct pollfd fds[16];
-    for (int i = 0; i < num_touch_devices; i++) {
-        fds[i] = (struct pollfd){touch_devices[i].fd, POLLIN, 0};
+// Advance the scripted clock, running frame ticks the way the frame timer would
+static void script_wait(int ms) {
+    int ticks = (int)((int64_t)ms * 1000000 / FRAME_INTERVAL_NS);
+    for (int i = 0; i < ticks; i++) {
+        headless_clock_ms += FRAME_INTERVAL_NS / 1000000;
+        perf_begin_frame();
+        uint64_t perf_start = perf_begin();
+        update_animations();
+        perf_end(PERF_ANIMATE, perf_start);
+        script_frame();
     }
+    headless_clock_ms += ms - ticks * (FRAME_INTERVAL_NS / 1000000);
+}
+
+// Drive the shell from a script instead of evdev and render into memory.
+// One command per line:
+//   down X Y | move X Y | up | tap X Y    touch reports
+//   wait MS                               advance time, running animation frames
+//   state home|switcher|app N             jump to a shell state
+//   expect home|switcher|app              stop with a failure unless in that state
+//   capture NAME                          save (or compare) OUT_DIR/NAME.ppm
+// With no OUT_DIR, captures benchmark render thread scaling instead.
+int run_headless(int width, int height, const char *script, const char *out_dir, int compare) {
+    headless = 1;
+    headless_clock_ms = 0;
+    fixed_clock = SNAPSHOT_CLOCK;
+    setenv("TZ", "UTC", 1);
+    tzset();
     
-    if (poll(fds, num_touch_devices, 0) <= 0) return;
+    if (out_dir && mkdir(out_dir, 0755) < 0 && errno != EEXIST) { perror(out_dir); return 1; }
     
-    for (int i = 0; i < num_touch_devices; i++) {
-        if (!(fds[i].revents & POLLIN)) continue;
-        
-        struct input_event ev;
-        int raw_x = touch.x, raw_y = touch.y, tracking = touch.pressed;
+    init_memory_presenter(width, height);
+    app_buffer = malloc(screen_w * screen_h * 4);
+    if (!app_buffer) { perror("App buffer allocation failed"); exit(1); }
+    init_render_pool(render_threads > 0 ? render_threads : sysconf(_SC_NPROCESSORS_ONLN));
+    init_job_pool();
+    init_blur_cache();
+    init_window_scaler();
+    
+    animation_target_state = current_state;
+    clip_rect = (Rect){0, 0, screen_w, screen_h};
+    invalidate_screen();
+    draw_invalid_region();
+    
+    size_t bytes = (size_t)screen_w * screen_h * 4;
+    uint32_t *incremental = malloc(bytes);
+    if (!incremental) { perror("Capture buffer allocation failed"); exit(1); }
+    
+    char *text = strdup(script);
+    char *save = NULL;
+    int line_no = 0, failures = 0, captures = 0;
+    
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        line_no++;
+        char cmd[32], arg[MAX_SCRIPT_LINE];
+        int x = 0, y = 0;
+        arg[0] = '\0';
+        if (sscanf(line, " %31s", cmd) != 1 || cmd[0] == '#') continue;
         
-        while (read(touch_devices[i].fd, &ev, sizeof(ev)) == sizeof(ev)) {
-            if (ev.type == EV_ABS) {
-                if (ev.code == ABS_X || ev.code == ABS_MT_POSITION_X) {
-                    raw_x = (ev.value - touch_devices[i].min_x) * screen_w / 
-                           (touch_devices[i].max_x - touch_devices[i].min_x + 1);
-                }
-                if (ev.code == ABS_Y || ev.code == ABS_MT_POSITION_Y) {
-                    raw_y = (ev.value - touch_devices[i].min_y) * screen_h / 
-                           (touch_devices[i].max_y - touch_devices[i].min_y + 1);
+        int ok = 1;
+        perf_begin_frame();
+        if (strcmp(cmd, "down") == 0 || strcmp(cmd, "move") == 0 || strcmp(cmd, "tap") == 0) {
+            ok = sscanf(line, " %*s %d %d", &x, &y) == 2;
+            if (ok) {
+                apply_touch_frame(x, y, 1, get_time_ms());
+                handle_touch_input();
+                if (strcmp(cmd, "tap") == 0) {
+                    script_frame();
+                    perf_begin_frame();
+                    apply_touch_frame(x, y, 0, get_time_ms());
+                    handle_touch_input();
                 }
-                if (ev.code == ABS_MT_TRACKING_ID) {
-                    tracking = (ev.value >= 0);
+            }
+        } else if (strcmp(cmd, "up") == 0) {
+            apply_touch_frame(touch.x, touch.y, 0, get_time_ms());
+            handle_touch_input();
+        } else if (strcmp(cmd, "wait") == 0) {
+            ok = sscanf(line, " %*s %d", &x) == 1 && x >= 0;
+            if (ok) script_wait(x);
+        } else if (strcmp(cmd, "state") == 0) {
+            x = -1;
+            ok = sscanf(line, " %*s %255s %d", arg, &x) >= 1 && script_set_state(arg, x);
+        } else if (strcmp(cmd, "expect") == 0) {
+            ok = sscanf(line, " %*s %255s", arg) == 1;
+            if (ok && strcmp(arg, script_state_name(current_state)) != 0) {
+                fprintf(stderr, "Script line %d: expected %s, shell is in %s\n",
+                        line_no, arg, script_state_name(current_state));
+                failures++;
+                break;
+            }
+        } else if (strcmp(cmd, "capture") == 0) {
+            ok = sscanf(line, " %*s %255s", arg) == 1;
+            if (ok) {
+                // Captures redraw in full, which must match what damage tracking drew
+                memcpy(incremental, framebuffer, bytes);
+                failures += out_dir ? snapshot_capture(arg, out_dir, compare) : bench_capture(arg);
+                if (memcmp(incremental, framebuffer, bytes) != 0) {
+                    printf("❌ %s: incremental frame differs from a full redraw\n", arg);
+                    failures++;
                 }
-            } else if (ev.type == EV_KEY && ev.code == BTN_TOUCH) {
-                tracking = ev.value;
-            } else if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
-                touch.last_pressed = touch.pressed;
-                touch.pressed = tracking;
-                touch.x = raw_x;
-                touch.y = raw_y;
-                touch.last_touch_time = get_time_ms();
+                captures++;
             }
+        } else {
+            ok = 0;
+        }
+        
+        if (!ok) {
+            fprintf(stderr, "Script line %d: bad command: %s\n", line_no, line);
+            failures++;
+            break;
         }
+        script_frame();
     }
+    free(text);
+    free(incremental);
+    
+    if (perf_active()) perf_dump(stdout);
+    printf("%s %d capture(s), %d failure(s)\n", failures ? "❌" : "✅", captures, failures);
+    shutdown_presenter();
+    free(app_buffer);
+    app_buffer = NULL;
+    return failures ? 1 : 0;
 }
 
-void cleanup_and_exit(int sig) {
-    if (framebuffer) {
-        clear_screen(framebuffer, COLOR_BG);
-        munmap(framebuffer, stride * screen_h);
-    }
-    if (backbuffer) free(backbuffer);
-    if (app_buffer) free(app_buffer);
-    if (fb_fd > 0) close(fb_fd);
-    for (int i = 0; i < num_touch_devices; i++) {
-        close(touch_devices[i].fd);
-    }
-    exit(0);
+// Read a whole script file into a NUL-terminated buffer
+static char *load_script(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    char *text = malloc(size + 1);
+    size_t got = fread(text, 1, size, f);
+    text[got] = '\0';
+    fclose(f);
+    return text;
 }
 
-int main(void) {
+int main(int argc, char **argv) {
     signal(SIGINT, cleanup_and_exit);
+    init_pixel_kernels();
+    
+    if (argc > 1 && strcmp(argv[1], "--test-kernels") == 0) {
+        return test_pixel_kernels() ? 1 : 0;
+    }
     
     // Initialize open apps array
     memset(open_apps, 0, sizeof(open_apps));
     
-    // Load font
-    FILE *font_file = fopen(FONT_PATH, "rb");
-    if (!font_file) { perror("Font load failed"); exit(1); }
-    fseek(font_file, 0, SEEK_END);
-    int font_size = ftell(font_file);
-    rewind(font_file);
-    unsigned char *font_data = malloc(font_size);
-    fread(font_data, 1, font_size, font_file);
-    fclose(font_file);
+    // Map the font; stb_truetype only reads it
+    struct stat font_stat;
+    size_t font_bytes;
+    const unsigned char *font_data = map_file(FONT_PATH, &font_bytes, &font_stat);
+    if (!font_data) { perror("Font load failed"); exit(1); }
     
     if (!stbtt_InitFont(&font, font_data, 0)) {
         fprintf(stderr, "Font initialization failed\n");
         exit(1);
     }
+    glyph_cache_init(GLYPH_CACHE_BYTES);
+    glyph_pack_init(GLYPH_PACK_PATH, &font_stat);
+    discover_apps(APPS_DIR);
     
-    // Initialize framebuffer
-    struct fb_var_screeninfo vinfo;
-    struct fb_fix_screeninfo finfo;
-    fb_fd = open("/dev/fb0", O_RDWR);
-    if (fb_fd < 0) { perror("Framebuffer open failed"); exit(1); }
-    
-    ioctl(fb_fd, FBIOGET_VSCREENINFO, &vinfo);
-    ioctl(fb_fd, FBIOGET_FSCREENINFO, &finfo);
+    // --threads N sizes the render pool, which otherwise gets one thread per CPU.
+    // --predict MS caps how far ahead drags are drawn, 0 turns prediction off.
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0) {
+            render_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--predict") == 0) {
+            predict_ms = atoi(argv[++i]);
+        }
+    }
     
-    screen_w = vinfo.xres;
-    screen_h = vinfo.yres;
-    stride = finfo.line_length;
+    // Frame statistics: --perf records, --perf-hud also draws the graph,
+    // --perf-file PATH appends SIGUSR1 dumps there. SIGUSR2 toggles the HUD.
+#if PERF_STATS
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) {
+            perf.enabled = 1;
+        } else if (strcmp(argv[i], "--perf-hud") == 0) {
+            perf.enabled = perf.hud = 1;
+        } else if (strcmp(argv[i], "--perf-file") == 0 && i + 1 < argc) {
+            perf.stats_path = argv[++i];
+        }
+    }
+    signal(SIGUSR1, request_perf_dump);
+    signal(SIGUSR2, request_perf_hud_toggle);
+#endif
     
-    framebuffer = mmap(0, stride * screen_h, PROT_READ | PROT_WRITE, MAP_SHARED, fb_fd, 0);
-    if (framebuffer == MAP_FAILED) { perror("Framebuffer mmap failed"); exit(1); }
+    // Offscreen modes: no framebuffer or input devices needed. --snapshot and
+    // --bench drive the Test app, so run them where apps/Test.so exists:
+    //     gcc -shared -fPIC -o apps/Test.so test.c
+    if ((argc > 2 && strcmp(argv[1], "--snapshot") == 0) || (argc > 1 && strcmp(argv[1], "--bench") == 0)) {
+        if (num_apps == 0) {
+            fprintf(stderr, "No app modules in %s/; build apps/Test.so from test.c first\n", APPS_DIR);
+            return 1;
+        }
+    }
+    if (argc > 2 && strcmp(argv[1], "--snapshot") == 0) {
+        int update = argc > 3 && strcmp(argv[3], "--update") == 0;
+        return run_headless(HEADLESS_DEFAULT_W, HEADLESS_DEFAULT_H, snapshot_script, argv[2], !update);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return run_headless(HEADLESS_DEFAULT_W, HEADLESS_DEFAULT_H, snapshot_script, NULL, 0);
+    }
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        int width, height;
+        if (argc < 5 || sscanf(argv[2], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+            fprintf(stderr, "Usage: %s --headless WIDTHxHEIGHT SCRIPT OUT_DIR\n", argv[0]);
+            return 1;
+        }
+        char *script = load_script(argv[3]);
+        if (!script) return 1;
+        int result = run_headless(width, height, script, argv[4], 0);
+        free(script);
+        return result;
+    }
     
-    backbuffer = malloc(screen_w * screen_h * 4);
-    if (!backbuffer) { perror("Backbuffer allocation failed"); exit(1); }
+    // Initialize framebuffer
+    fb_fd = open("/dev/fb0", O_RDWR);
+    if (fb_fd < 0) { perror("Framebuffer open failed"); exit(1); }
+    init_presenter();
     
     app_buffer = malloc(screen_w * screen_h * 4);
     if (!app_buffer) { perror("App buffer allocation failed"); exit(1); }
     
+    init_render_pool(render_threads > 0 ? render_threads : sysconf(_SC_NPROCESSORS_ONLN));
+    init_job_pool();
+    init_blur_cache();
+    init_window_scaler();
+    
     init_touch_devices();
+    init_event_loop();
+    init_input_thread();
     
     animation_target_state = current_state;
+    clip_rect = (Rect){0, 0, screen_w, screen_h};
+    invalidate_screen();
     
     printf("📱 SIMPLIFIED PHONE OS! 🚀\n");
     printf("✅ No more lock screen/PIN complexity\n");
@@ -791,79 +5483,31 @@ int main(void) {
     printf("🔄 App switcher: swipe up from home (if apps open)\n");
     printf("🎯 Focus on core app navigation!\n");
     
+    draw_invalid_region();
     while (1) {
-        read_touch_events();
-        handle_touch_input();
-        update_animations();
+        LoopEvents events = wait_for_events(ms_until_next_minute());
+        perf_begin_frame();
+        perf_handle_requests();
         
-        if (current_scale >= 0.98f && !touch.is_dragging_indicator) {
-            switch (current_state) {
-                case HOME_SCREEN: draw_home_screen(backbuffer); break;
-                case APP_SCREEN: draw_app_screen(backbuffer); break;
-                case APP_SWITCHER: draw_app_switcher(backbuffer); break;
-            }
-        } else {
-            // Render target state as background (don't blur home screen)
-            if (animation_target_state == HOME_SCREEN) {
-                draw_home_screen(backbuffer);
-                
-                // Only render scaled app if scale is large enough to be visible
-                if (current_scale > 0.15f) {
-                    switch (current_state) {
-                        case HOME_SCREEN: draw_home_screen(app_buffer); break;
-                        case APP_SCREEN: draw_app_screen(app_buffer); break;
-                        case APP_SWITCHER: draw_app_switcher(app_buffer); break;
-                    }
-                    
-                    if (touch.is_dragging_indicator) {
-                        draw_scaled_window(backbuffer, app_buffer, current_scale, touch.finger_x, touch.finger_y);
-                    } else {
-                        draw_scaled_window(backbuffer, app_buffer, current_scale, screen_w/2, screen_h/2);
-                    }
-                }
-            } else {
-                draw_home_screen(backbuffer);
-                float blur_amount = (1.0f - current_scale) * 0.5f;
-                if (blur_amount > 0.1f) {
-                    apply_fast_blur(backbuffer, blur_amount);
-                }
-                
-                switch (current_state) {
-                    case HOME_SCREEN: draw_home_screen(app_buffer); break;
-                    case APP_SCREEN: draw_app_screen(app_buffer); break;
-                    case APP_SWITCHER: draw_app_switcher(app_buffer); break;
-                }
-                
-                if (touch.is_dragging_indicator) {
-                    draw_scaled_window(backbuffer, app_buffer, current_scale, touch.finger_x, touch.finger_y);
-                } else {
-                    draw_scaled_window(backbuffer, app_buffer, current_scale, screen_w/2, screen_h/2);
-                }
-            }
-            
-            if (touch.is_dragging_indicator) {
-                int scaled_h = (int)(screen_h * current_scale);
-                int bar_w = 240;
-                int bar_x = touch.finger_x - bar_w/2;
-                int bar_y = touch.finger_y - 80; // Position relative to bottom of scaled window
-                
-                // Keep bar on screen
-                if (bar_x < 20) bar_x = 20;
-                if (bar_x + bar_w > screen_w - 20) bar_x = screen_w - 20 - bar_w;
-                if (bar_y < 0) bar_y = 0;
-                if (bar_y > screen_h - 24) bar_y = screen_h - 24;
-                
-                draw_rounded_rect(backbuffer, bar_x, bar_y, bar_w, 24, 12, COLOR_BLUE);
-            }
+        // Touch reports and finished jobs both arrive through wake_main_loop
+        uint64_t perf_start = 0;
+        if (events.woken) {
+            perf_start = perf_begin();
+            if (read_touch_events() > 0) perf_end(PERF_TOUCH, perf_start);
+            run_completed_jobs();
         }
-        
-        if (touch.pressed) {
-            draw_circle_filled(backbuffer, touch.x, touch.y, 8, COLOR_RED);
+        if (events.frame_ticks > 0) {
+            // Animations follow the clock, so one update covers every tick
+            perf_start = perf_begin();
+            update_animations();
+            perf_end(PERF_ANIMATE, perf_start);
+            // Ticks beyond the first were frames the timer expected but we never drew
+            if (perf_active()) perf.missed_deadlines += events.frame_ticks - 1;
         }
+        // Predicted drags keep ticking so the window settles when the finger stops
+        set_frame_timer(animations_active() || touch.predicting);
         
-        memcpy(framebuffer, backbuffer, screen_w * screen_h * 4);
-        
-        usleep(16666); // 60 FPS
+        perf_end_frame(draw_invalid_region());
     }
     
     return 0;
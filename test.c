@@ -6,40 +6,33 @@
 // Global state for the test app
 static char ping_result[256] = "Ready to test connectivity";
 static int ping_in_progress = 0;
+static int ping_exit_status;    // Written by the job thread, read in ping_done
 
 // Circle button dimensions and position
 #define BUTTON_RADIUS 100
 #define BUTTON_CENTER_X (screen_w / 2)
 #define BUTTON_CENTER_Y (STATUS_HEIGHT + 280)
 
+// Button, result and instruction text - everything a ping changes
+#define PING_AREA_TOP (BUTTON_CENTER_Y - BUTTON_RADIUS - 2)
+#define PING_AREA_HEIGHT (STATUS_HEIGHT + 460 + SMALL_TEXT * 2 - PING_AREA_TOP)
+
 // Function to check if touch is within circular button bounds
-int is_touching_ping_button(int touch_x, int touch_y) {
+static int is_touching_ping_button(int touch_x, int touch_y) {
     int dx = touch_x - BUTTON_CENTER_X;
     int dy = touch_y - BUTTON_CENTER_Y;
     int distance_squared = dx * dx + dy * dy;
     return distance_squared <= (BUTTON_RADIUS * BUTTON_RADIUS);
 }
 
-// Function to handle touch input for the test app
-void handle_test_app_touch(int touch_x, int touch_y, int is_pressed, int was_pressed) {
-    // Button press detection - only trigger on press down, not while held
-    if (is_pressed && !was_pressed && is_touching_ping_button(touch_x, touch_y)) {
-        if (!ping_in_progress) {
-            simple_ping();
-        }
-    }
+// Runs on a job thread - only touches ping_exit_status
+static void ping_work(void *data) {
+    ping_exit_status = system("ping -c 1 -W 1 example.org >/dev/null 2>&1");
 }
 
-// Simple ping function
-void simple_ping(void) {
-    if (ping_in_progress) return;
-    
-    ping_in_progress = 1;
-    
-    // Use system command for ping
-    int result = system("ping -c 1 -W 1 example.org >/dev/null 2>&1");
-    
-    if (result == 0) {
+// Back on the UI thread once the ping has finished
+static void ping_done(void *data) {
+    if (ping_exit_status == 0) {
         strncpy(ping_result, "SUCCESS: example.org reachable", sizeof(ping_result) - 1);
     } else {
         strncpy(ping_result, "FAILED: example.org not reachable", sizeof(ping_result) - 1);
@@ -49,7 +42,27 @@ void simple_ping(void) {
     ping_in_progress = 0;
 }
 
-void draw_test_app(uint32_t *buf) {
+// Start a ping in the background; the button shows WAIT... until it completes
+static void simple_ping(void) {
+    if (ping_in_progress) return;
+    
+    if (!submit_job(ping_work, ping_done, NULL, 0, PING_AREA_TOP, screen_w, PING_AREA_HEIGHT)) return;
+    
+    ping_in_progress = 1;
+    invalidate_rect(0, PING_AREA_TOP, screen_w, PING_AREA_HEIGHT);
+}
+
+// Function to handle touch input for the test app
+static void handle_test_app_touch(int touch_x, int touch_y, int is_pressed, int was_pressed) {
+    // Button press detection - only trigger on press down, not while held
+    if (is_pressed && !was_pressed && is_touching_ping_button(touch_x, touch_y)) {
+        if (!ping_in_progress) {
+            simple_ping();
+        }
+    }
+}
+
+static void draw_test_app(uint32_t *buf) {
     // Note: Title "Test" is already drawn by the main app system at STATUS_HEIGHT + 50
     
     // Draw subtitle below the existing title
@@ -83,4 +96,6 @@ void draw_test_app(uint32_t *buf) {
     } else {
         draw_text_centered(buf, "Testing connection...", SMALL_TEXT, STATUS_HEIGHT + 460, COLOR_BLUE);
     }
-}
\ No newline at end of file
+}
+
+const AppModule app_module = {APP_MODULE_ABI_VERSION, draw_test_app, handle_test_app_touch, NULL, NULL};